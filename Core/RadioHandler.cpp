@@ -3,15 +3,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
-#include "pffft/pf_mixer.h"
 #include "RadioHandler.h"
 #include "config.h"
 #include "fft_mt_r2iq.h"
 #include "config.h"
 #include "PScope_uti.h"
+#include "thread_placement.h"
 #include "../Interface.h"
 
 #include <chrono>
+#include <vector>
 
 using namespace std::chrono;
 
@@ -21,7 +22,7 @@ unsigned long Failures = 0;
 
 void RadioHandlerClass::OnDataPacket()
 {
-	auto len = outputbuffer.getBlockSize() / 2 / sizeof(float);
+	auto len = outputbuffer.getBlockSize() / outputFormat.sampleBytes();
 
 	while(run)
 	{
@@ -30,12 +31,6 @@ void RadioHandlerClass::OnDataPacket()
 		if (!run)
 			break;
 
-		if (fc != 0.0f)
-		{
-			std::unique_lock<std::mutex> lk(fc_mutex);
-			shift_limited_unroll_C_sse_inp_c((complexf*)buf, len, stateFineTune);
-		}
-
 #ifdef _DEBUG		//PScope buffer screenshot
 		if (saveADCsamplesflag == true)
 		{
@@ -56,7 +51,27 @@ void RadioHandlerClass::OnDataPacket()
 	}
 }
 
+// the r2iq drops the frames a slow callback does not keep up with
+void RadioHandlerClass::OnSpectrum()
+{
+	while(run)
+	{
+		auto frame = spectrumbuffer.getReadPtr();
+
+		if (!run)
+			break;
+
+		SpectrumCallback(spectrumContext, frame, spectrumBins);
+
+		spectrumbuffer.ReadDone();
+	}
+}
+
 RadioHandlerClass::RadioHandlerClass() :
+	SpectrumCallback(nullptr),
+	spectrumContext(nullptr),
+	spectrumBins(0),
+	spectrumRate(0.0f),
 	DbgPrintFX3(nullptr),
 	GetConsoleIn(nullptr),
 	run(false),
@@ -67,18 +82,15 @@ RadioHandlerClass::RadioHandlerClass() :
 	biasT_VHF(false),
 	firmware(0),
 	modeRF(NOMODE),
+	spectrumbuffer(4),
 	adcrate(DEFAULT_ADC_FREQ),
-	fc(0.0f),
 	hardware(new DummyRadio(nullptr))
 {
 	inputbuffer.setBlockSize(transferSamples);
-
-	stateFineTune = new shift_limited_unroll_C_sse_data_t();
 }
 
 RadioHandlerClass::~RadioHandlerClass()
 {
-	delete stateFineTune;
 }
 
 const char *RadioHandlerClass::getName()
@@ -148,9 +160,6 @@ bool RadioHandlerClass::Init(fx3class* Fx3, void (*callback)(void*context, const
 
 bool RadioHandlerClass::Start(int srate_idx)
 {
-	Stop();
-	DbgPrintf("RadioHandlerClass::Start\n");
-
 	int	decimate = 4 - srate_idx;   // 5 IF bands
 	if (adcnominalfreq > N2_BANDSWITCH) 
 		decimate = 5 - srate_idx;   // 6 IF bands
@@ -159,30 +168,117 @@ bool RadioHandlerClass::Start(int srate_idx)
 		decimate = 0;
 		DbgPrintf("WARNING decimate mismatch at srate_idx = %d\n", srate_idx);
 	}
+	return StartDecimation(decimate);
+}
+
+double RadioHandlerClass::PlanSampleRate(double rate, int& decimate, int& interp, int& decim)
+{
+	double decimated = adcrate / 2.0;
+	if (rate <= 0.0 || rate > decimated)
+		return 0.0;
+
+	decimate = 0;
+	while (decimate + 1 < NDECIMATE && decimated / 2.0 >= rate)
+	{
+		decimated /= 2.0;
+		decimate++;
+	}
+	if (rate < decimated / 2.0)
+		return 0.0;
+
+	return decimated * rationalResampler::approximate(rate / decimated, interp, decim);
+}
+
+bool RadioHandlerClass::UpdateDecimation(int decimate, int interp, int decim)
+{
+	if (run && r2iqCntrl->reconfigure(decimate, r2iqCntrl->getSideband(), interp, decim))
+	{
+		DbgPrintf("RadioHandlerClass::UpdateDecimation decimate %d resample %d / %d\n", decimate, interp, decim);
+		return true;
+	}
+	return StartDecimation(decimate, interp, decim);
+}
+
+bool RadioHandlerClass::StartDecimation(int decimate, int interp, int decim)
+{
+	if (decimate < 0 || decimate >= NDECIMATE)
+		return false;
+	if (interp < 1 || interp > decim || interp > RESAMPLE_MAX_INTERP)
+		return false;
+
+	Stop();
+	DbgPrintf("RadioHandlerClass::Start decimate %d resample %d / %d\n", decimate, interp, decim);
+
 	run = true;
 	count = 0;
 
 	hardware->FX3producerOn();  // FX3 start the producer
 
-	outputbuffer.setBlockSize(EXT_BLOCKLEN * 2 * sizeof(float));
+	outputbuffer.setBlockSize(EXT_BLOCKLEN * outputFormat.sampleBytes());
 
 	// 0,1,2,3,4 => 32,16,8,4,2 MHz
 	r2iqCntrl->setDecimate(decimate);
+	r2iqCntrl->setResample(interp, decim);
+	r2iqCntrl->setOutputFormat(outputFormat);
+	bool spectrum = false;
+	if (SpectrumCallback != nullptr)
+	{
+		spectrumbuffer.setBlockSize(spectrumBins);
+		spectrum = r2iqCntrl->setSpectrum(&spectrumbuffer, spectrumBins, spectrumBlocks(spectrumRate));
+	}
+	else
+	{
+		r2iqCntrl->setSpectrum(nullptr, 0, 1);
+	}
 	r2iqCntrl->TurnOn();
 	fx3->StartStream(inputbuffer, QUEUE_SIZE);
 
 	submit_thread = std::thread(
 		[this]() {
+			threadScope scope(THREAD_CALLBACK, "sddc-callback");
 			this->OnDataPacket();
 		});
 
+	if (spectrum)
+		spectrum_thread = std::thread([this]() {
+			threadScope scope(THREAD_SPECTRUM, "sddc-spectrum");
+			this->OnSpectrum();
+		});
+
 	show_stats_thread = std::thread([this](void*) {
+		threadScope scope(THREAD_STATS, "sddc-stats");
 		this->CaculateStats();
 	}, nullptr);
 
 	return true;
 }
 
+// whole input blocks per frame
+int RadioHandlerClass::spectrumBlocks(float frameRate) const
+{
+	return (frameRate > 0.0f) ? std::max(1, (int)(adcrate / (double)transferSamples / frameRate + 0.5)) : 1;
+}
+
+// asks the r2iq now, StartDecimation() sets it again at the rate it starts with
+bool RadioHandlerClass::SetSpectrum(int bins, float frameRate, void (*callback)(void* context, const float* power, uint32_t bins), void* context)
+{
+	bool accepted = true;
+	if (callback != nullptr)
+	{
+		accepted = r2iqCntrl->setSpectrum(&spectrumbuffer, bins, spectrumBlocks(frameRate));
+		if (!accepted)
+			callback = nullptr;
+	}
+	if (callback == nullptr)
+		r2iqCntrl->setSpectrum(nullptr, 0, 1);
+
+	spectrumBins = bins;
+	spectrumRate = frameRate;
+	SpectrumCallback = callback;
+	spectrumContext = context;
+	return accepted;
+}
+
 bool RadioHandlerClass::Stop()
 {
 	std::unique_lock<std::mutex> lk(stop_mutex);
@@ -203,6 +299,12 @@ bool RadioHandlerClass::Stop()
 		submit_thread.join();
 		DbgPrintf("submit_thread join1\n");
 
+		if (spectrum_thread.joinable())
+		{
+			spectrumbuffer.Stop();
+			spectrum_thread.join();
+		}
+
 		hardware->FX3producerOff();     //FX3 stop the producer
 	}
 	return true;
@@ -265,10 +367,10 @@ bool RadioHandlerClass::UpdatemodeRF(rf_mode mode)
 
 		hardware->UpdatemodeRF(mode);
 
-		if (mode == VHFMODE)
-			r2iqCntrl->setSideband(true);
-		else
-			r2iqCntrl->setSideband(false);
+		// while running the r2iq switches with a later block
+		const bool lsb = (mode == VHFMODE);
+		if (!run || !r2iqCntrl->reconfigure(r2iqCntrl->getDecimate(), lsb, r2iqCntrl->getResampleInterp(), r2iqCntrl->getResampleDecim()))
+			r2iqCntrl->setSideband(lsb);
 	}
 	return true;
 }
@@ -284,18 +386,10 @@ uint64_t RadioHandlerClass::TuneLO(uint64_t wishedFreq)
 
 	actLo = hardware->TuneLo(wishedFreq);
 
-	// we need shift the samples
+	// we need shift the samples, r2iq does it including the fine tuning
 	int64_t offset = wishedFreq - actLo;
 	DbgPrintf("Offset freq %" PRIi64 "\n", offset);
-	float fc = r2iqCntrl->setFreqOffset(offset / (getSampleRate() / 2.0f));
-	if (GetmodeRF() == VHFMODE)
-		fc = -fc;   // sign change with sideband used
-	if (this->fc != fc)
-	{
-		std::unique_lock<std::mutex> lk(fc_mutex);
-		*stateFineTune = shift_limited_unroll_C_sse_init(fc, 0.0F);
-		this->fc = fc;
-	}
+	r2iqCntrl->setFreqOffset(offset / (getSampleRate() / 2.0f));
 
 	return wishedFreq;
 }
@@ -331,6 +425,28 @@ bool RadioHandlerClass::UptRand(bool b)
 	return randout;
 }
 
+// the cpu time of the threads and their load of one cpu since the last
+// report, the times of the last one in 'last'
+static void ReportThreadTimes(std::vector<threadTime>& last, float elapsed)
+{
+	threadTime times[32];
+	const int count = threadGetTimes(times, 32);
+	for (int i = 0; i < count; i++)
+	{
+		double before = 0.0;
+		for (auto& t : last)
+		{
+			if (strcmp(t.name, times[i].name) == 0)
+				before = t.seconds;
+		}
+		DbgPrintf("%s%s %.1fs %.0f%%", i == 0 ? "threads: " : ", ", times[i].name,
+			times[i].seconds, 100.0 * (times[i].seconds - before) / elapsed);
+	}
+	if (count > 0)
+		DbgPrintf("\n");
+	last.assign(times, times + count);
+}
+
 void RadioHandlerClass::CaculateStats()
 {
 	high_resolution_clock::time_point EndingTime;
@@ -347,6 +463,8 @@ void RadioHandlerClass::CaculateStats()
 	memset(debdata, 0, MAXLEN_D_USB);
 
 	auto StartingTime = high_resolution_clock::now();
+	auto ReportTime = StartingTime;
+	std::vector<threadTime> times;
 
 	while (run) {
 		kbRead = float(BytesXferred) / 1000.0f;
@@ -363,6 +481,14 @@ void RadioHandlerClass::CaculateStats()
 		SamplesXIF = 0;
 
 		StartingTime = high_resolution_clock::now();
+
+		// every 10 s
+		duration<float,std::ratio<1,1>> sinceReport(StartingTime - ReportTime);
+		if (sinceReport.count() >= 10.0f)
+		{
+			ReportThreadTimes(times, sinceReport.count());
+			ReportTime = StartingTime;
+		}
 	
 #ifdef _DEBUG  
 		int nt = 10;
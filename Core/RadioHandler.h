@@ -11,6 +11,7 @@
 #include "FX3Class.h"
 
 #include "dsp/ringbuffer.h"
+#include "r2iq.h"
 
 class RadioHardware;
 class r2iqControlClass;
@@ -23,15 +24,33 @@ enum {
     RESULT_NOT_POSSIBLE
 };
 
-struct shift_limited_unroll_C_sse_data_s;
-typedef struct shift_limited_unroll_C_sse_data_s shift_limited_unroll_C_sse_data_t;
-
 class RadioHandlerClass {
 public:
     RadioHandlerClass();
     virtual ~RadioHandlerClass();
+    // the callback gets blocks of 'len' samples in the output format
     bool Init(fx3class* Fx3, void (*callback)(void* context, const float*, uint32_t), r2iqControlClass *r2iqCntrl = nullptr, void* context = nullptr);
     bool Start(int srate_idx);
+    // output rate adcrate / 2 / 2^decimate, 0 .. NDECIMATE - 1, resampled
+    // by interp / decim <= 1
+    bool StartDecimation(int decimate, int interp = 1, int decim = 1);
+    // any output rate down to the lowest decimation: the highest decimation
+    // at least as fast, which leaves the least work to the fft stage and
+    // the resampler, then the resampling ratio. Returns the rate they give,
+    // 0 if it is out of range
+    double PlanSampleRate(double rate, int& decimate, int& interp, int& decim);
+    // changes the output rate while running without stopping the stream,
+    // see r2iqControlClass::reconfigure(); restarts with StartDecimation()
+    // when stopped or if the r2iq cannot
+    bool UpdateDecimation(int decimate, int interp = 1, int decim = 1);
+    // sample format of the callback, takes effect with the next Start
+    void SetOutputFormat(const r2iqOutputFormat& format) { outputFormat = format; }
+    // wideband power spectrum of the ADC input, see fft_mt_r2iq::setSpectrum():
+    // frames of 'bins' from 0 to adcrate / 2, about 'frameRate' per second,
+    // to their own callback in their own thread. A null callback turns it
+    // off, takes effect with the next Start; false, and off, if the r2iq
+    // cannot deliver it
+    bool SetSpectrum(int bins, float frameRate, void (*callback)(void* context, const float* power, uint32_t bins), void* context);
     bool Stop();
     bool Close();
     bool IsReady(){return true;}
@@ -55,6 +74,9 @@ public:
     uint32_t getSampleRate() { return adcrate; }
     bool UpdateSampleRate(uint32_t samplerate);
 
+    // ADC statistics of the r2iq, see r2iqControlClass::getAdcStats()
+    adcStats GetAdcStats(bool reset = false) { return r2iqCntrl->getAdcStats(reset); }
+
     float getBps() const { return mBps; }
     float getSpsIF() const {return mSpsIF; }
 
@@ -84,10 +106,16 @@ private:
     void AbortXferLoop(int qidx);
     void CaculateStats();
     void OnDataPacket();
+    void OnSpectrum();
+    int spectrumBlocks(float frameRate) const;
     r2iqControlClass* r2iqCntrl;
 
     void (*Callback)(void* context, const float *data, uint32_t length);
     void *callbackContext;
+    void (*SpectrumCallback)(void* context, const float* power, uint32_t bins);
+    void *spectrumContext;
+    int spectrumBins;
+    float spectrumRate;
     void (*DbgPrintFX3)(const char* fmt, ...);
     bool (*GetConsoleIn)(char* buf, int maxlen);
 
@@ -106,10 +134,13 @@ private:
     // transfer variables
     ringbuffer<int16_t> inputbuffer;
     ringbuffer<float> outputbuffer;
+    r2iqOutputFormat outputFormat;
+    ringbuffer<float> spectrumbuffer;
 
     // threads
     std::thread show_stats_thread;
     std::thread submit_thread;
+    std::thread spectrum_thread;
 
     // stats
     unsigned long BytesXferred;
@@ -120,11 +151,8 @@ private:
     fx3class *fx3;
     uint32_t adcrate;
 
-    std::mutex fc_mutex;
     std::mutex stop_mutex;
-    float fc;
     RadioHardware* hardware;
-    shift_limited_unroll_C_sse_data_t* stateFineTune;
 };
 
 extern unsigned long Failures;
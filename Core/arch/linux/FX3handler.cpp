@@ -2,6 +2,7 @@
 
 #include "FX3handler.h"
 #include "usb_device.h"
+#include "../../thread_placement.h"
 
 fx3class* CreateUsbHandler()
 {
@@ -59,6 +60,7 @@ void fx3handler::StartStream(ringbuffer<int16_t>& input, int numofblock)
     run = true;
     poll_thread = std::thread(
         [this]() {
+            threadScope scope(THREAD_USB, "sddc-usb");
             while(run)
             {
                 usb_device_handle_events(this->dev);
@@ -10,6 +10,7 @@
 #include <windows.h>
 #include "../../config.h"
 #include "FX3handler.h"
+#include "../../thread_placement.h"
 #include "./CyAPI/CyAPI.h"
 #include "./CyAPI/cyioctl.h"
 #define RES_BIN_FIRMWARE                2000
@@ -386,6 +387,7 @@ void fx3handler::StartStream(ringbuffer<int16_t>& input, int numofblock)
 	run = true;
 	adc_samples_thread = new std::thread(
 		[this]() {
+			threadScope scope(THREAD_USB, "sddc-usb");
 			this->AdcSamplesProcess();
 		}
 	);
@@ -0,0 +1,342 @@
+#include "license.txt"
+
+#include "buffer_arena.h"
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <new>
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+#define ARENA_CHUNK (256 * 1024)        // of small blocks, on normal pages
+#define ARENA_LARGE (ARENA_CHUNK / 4)   // blocks which get a mapping of their own
+#define ARENA_PAGE 4096
+
+namespace {
+	// a chunk of small blocks or a large block
+	struct region {
+		size_t size;        // of the mapping
+		size_t used;        // of a chunk, carved so far
+		int live;           // blocks in it
+		bool chunk;
+		bool huge;
+		bool locked;
+	};
+
+	struct arenaState {
+		std::mutex mutex;
+		unsigned flags;
+		std::map<uintptr_t, region> regions;
+		uintptr_t current;  // the chunk small blocks are carved from, 0 for none
+		size_t hugeSize;    // transparent huge pages or large pages, 0 without
+		size_t hugetlbSize; // the reserved ones of MAP_HUGETLB, 0 without
+		bool warned;
+	};
+
+#if !defined(_WIN32)
+	// the number after 'key' at the start of a line of a /proc or /sys
+	// file, times 'unit'; 0 without
+	size_t readSize(const char* path, const char* key, size_t unit)
+	{
+		FILE* file = fopen(path, "r");
+		if (file == nullptr)
+			return 0;
+		const size_t len = strlen(key);
+		char line[256];
+		size_t value = 0;
+		while (value == 0 && fgets(line, sizeof(line), file) != nullptr)
+		{
+			if (strncmp(line, key, len) == 0)
+				value = (size_t)strtoull(line + len, nullptr, 10) * unit;
+		}
+		fclose(file);
+		return value;
+	}
+#endif
+
+	unsigned parseFlags(const char* text)
+	{
+		unsigned flags = 0;
+		const char* s = text;
+		while (*s != 0)
+		{
+			size_t len = strcspn(s, ",");
+			if (len == 4 && strncmp(s, "huge", 4) == 0)
+				flags |= bufferArena::HUGE_PAGES;
+			else if (len == 8 && strncmp(s, "prefault", 8) == 0)
+				flags |= bufferArena::PREFAULT;
+			else if (len == 4 && strncmp(s, "lock", 4) == 0)
+				flags |= bufferArena::LOCK;
+			s += len;
+			if (*s == ',')
+				s++;
+		}
+		return flags;
+	}
+
+	// never destroyed, ring buffers of static objects may outlive the others
+	arenaState& state()
+	{
+		static arenaState* arena = []() {
+			auto arena = new arenaState();
+			arena->flags = bufferArena::HUGE_PAGES | bufferArena::PREFAULT;
+			arena->current = 0;
+			arena->warned = false;
+#if defined(_WIN32)
+			arena->hugeSize = GetLargePageMinimum();
+			arena->hugetlbSize = 0;
+#else
+			arena->hugetlbSize = readSize("/proc/meminfo", "Hugepagesize:", 1024);
+			arena->hugeSize = readSize("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "", 1);
+			if (arena->hugeSize == 0)
+				arena->hugeSize = arena->hugetlbSize;
+#endif
+			const char* env = getenv("SDDC_ARENA");
+			if (env != nullptr && env[0] != 0)
+				arena->flags = parseFlags(env);
+			return arena;
+		}();
+		return *arena;
+	}
+
+	size_t roundUp(size_t size, size_t unit)
+	{
+		return (size + unit - 1) / unit * unit;
+	}
+
+	// a mapping of at least 'size' bytes, which returns its size; on huge
+	// pages for the blocks of at least one
+	void* mapRegion(const arenaState& arena, size_t& size, bool& huge)
+	{
+		huge = false;
+		const bool hugePages = (arena.flags & bufferArena::HUGE_PAGES) != 0;
+#if defined(_WIN32)
+		if (hugePages && arena.hugeSize > 0 && size >= arena.hugeSize)
+		{
+			// needs SeLockMemoryPrivilege, large pages are always locked
+			const size_t hugeSize = roundUp(size, arena.hugeSize);
+			void* ptr = VirtualAlloc(nullptr, hugeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (ptr != nullptr)
+			{
+				size = hugeSize;
+				huge = true;
+				return ptr;
+			}
+		}
+		size = roundUp(size, ARENA_PAGE);
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+#ifdef MAP_HUGETLB
+		if (hugePages && arena.hugetlbSize > 0 && size >= arena.hugetlbSize)
+		{
+			// the reserved huge pages, if there are any
+			const size_t hugeSize = roundUp(size, arena.hugetlbSize);
+			void* ptr = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ptr != MAP_FAILED)
+			{
+				size = hugeSize;
+				huge = true;
+				return ptr;
+			}
+		}
+#endif
+		size = roundUp(size, ARENA_PAGE);
+		if (hugePages && arena.hugeSize > 0 && size >= arena.hugeSize)
+		{
+			// else transparent huge pages, which need an aligned mapping
+			const size_t align = arena.hugeSize;
+			uint8_t* ptr8 = (uint8_t*)mmap(nullptr, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (ptr8 == (uint8_t*)MAP_FAILED)
+				return nullptr;
+			const size_t head = roundUp((uintptr_t)ptr8, align) - (uintptr_t)ptr8;
+			if (head > 0)
+				munmap(ptr8, head);
+			munmap(ptr8 + head + size, align - head);
+			ptr8 += head;
+#ifdef MADV_HUGEPAGE
+			huge = (madvise(ptr8, size, MADV_HUGEPAGE) == 0);
+#endif
+			return ptr8;
+		}
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return (ptr != MAP_FAILED) ? ptr : nullptr;
+#endif
+	}
+
+	// touch every page of a block, huge pages come in whole on the first one
+	void prefault(void* ptr, size_t size)
+	{
+		volatile uint8_t* page = (volatile uint8_t*)ptr;
+		for (size_t offset = 0; offset < size; offset += ARENA_PAGE)
+			page[offset] = 0;
+		page[size - 1] = 0;
+	}
+
+	void unmapRegion(void* ptr, const region& r)
+	{
+#if defined(_WIN32)
+		if (r.locked && !r.huge)
+			VirtualUnlock(ptr, r.size);
+		VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+		if (r.locked)
+			munlock(ptr, r.size);
+		munmap(ptr, r.size);
+#endif
+	}
+
+	// under the mutex
+	uintptr_t newRegion(arenaState& arena, size_t size, bool chunk)
+	{
+		region r;
+		r.size = size;
+		r.used = 0;
+		r.live = 0;
+		r.chunk = chunk;
+		r.locked = false;
+		void* ptr = mapRegion(arena, r.size, r.huge);
+		if (ptr == nullptr)
+			return 0;
+
+		// the blocks of a chunk as they are carved
+		if ((arena.flags & bufferArena::PREFAULT) && !chunk)
+			prefault(ptr, r.size);
+		if (arena.flags & bufferArena::LOCK)
+		{
+#if defined(_WIN32)
+			r.locked = r.huge || VirtualLock(ptr, r.size);
+#else
+			r.locked = (mlock(ptr, r.size) == 0);
+#endif
+			if (!r.locked && !arena.warned)
+			{
+				arena.warned = true;
+				DbgPrintf("arena: cannot lock %u bytes in memory\n", (unsigned)r.size);
+			}
+		}
+		arena.regions[(uintptr_t)ptr] = r;
+		return (uintptr_t)ptr;
+	}
+}
+
+void bufferArena::setFlags(unsigned flags)
+{
+	auto& arena = state();
+	std::unique_lock<std::mutex> lk(arena.mutex);
+	arena.flags = flags;
+	// the next small blocks in a chunk of these
+	if (arena.current != 0 && arena.regions[arena.current].live == 0)
+	{
+		unmapRegion((void*)arena.current, arena.regions[arena.current]);
+		arena.regions.erase(arena.current);
+	}
+	arena.current = 0;
+}
+
+unsigned bufferArena::getFlags()
+{
+	auto& arena = state();
+	std::unique_lock<std::mutex> lk(arena.mutex);
+	return arena.flags;
+}
+
+void* bufferArena::alloc(size_t size)
+{
+#if defined(__SANITIZE_ADDRESS__)
+	// the sanitizer sees the overruns of separate allocations only
+	return ::operator new(size, std::align_val_t(ALIGNMENT), std::nothrow);
+#endif
+	auto& arena = state();
+	size = roundUp(size > 0 ? size : 1, ALIGNMENT);
+	std::unique_lock<std::mutex> lk(arena.mutex);
+
+	if (size >= ARENA_LARGE)
+	{
+		const uintptr_t base = newRegion(arena, size, false);
+		if (base == 0)
+			return nullptr;
+		arena.regions[base].live = 1;
+		return (void*)base;
+	}
+
+	if (arena.current == 0 || arena.regions[arena.current].used + size > arena.regions[arena.current].size)
+	{
+		// the full chunk goes once its blocks are freed
+		if (arena.current != 0 && arena.regions[arena.current].live == 0)
+		{
+			unmapRegion((void*)arena.current, arena.regions[arena.current]);
+			arena.regions.erase(arena.current);
+		}
+		arena.current = newRegion(arena, ARENA_CHUNK, true);
+		if (arena.current == 0)
+			return nullptr;
+	}
+	region& chunk = arena.regions[arena.current];
+	void* ptr = (void*)(arena.current + chunk.used);
+	chunk.used += size;
+	chunk.live++;
+	if (arena.flags & PREFAULT)
+		prefault(ptr, size);
+	return ptr;
+}
+
+void bufferArena::free(void* ptr)
+{
+	if (ptr == nullptr)
+		return;
+#if defined(__SANITIZE_ADDRESS__)
+	::operator delete(ptr, std::align_val_t(ALIGNMENT));
+	return;
+#endif
+	auto& arena = state();
+	std::unique_lock<std::mutex> lk(arena.mutex);
+
+	auto it = arena.regions.upper_bound((uintptr_t)ptr);
+	if (it == arena.regions.begin())
+		return;
+	--it;
+	region& r = it->second;
+	if ((uintptr_t)ptr >= it->first + r.size || --r.live > 0)
+		return;
+
+	if (it->first == arena.current)
+	{
+		// the chunk in use starts over
+		r.used = 0;
+		return;
+	}
+	unmapRegion((void*)it->first, r);
+	arena.regions.erase(it);
+}
+
+size_t bufferArena::getHugePageSize()
+{
+	return state().hugeSize;
+}
+
+bufferArena::usage bufferArena::getUsage()
+{
+	auto& arena = state();
+	std::unique_lock<std::mutex> lk(arena.mutex);
+	usage u;
+	memset(&u, 0, sizeof(u));
+	for (auto& it : arena.regions)
+	{
+		const region& r = it.second;
+		u.mapped += r.size;
+		if (r.huge)
+			u.huge += r.size;
+		if (r.locked)
+			u.locked += r.size;
+		u.blocks += r.live;
+	}
+	return u;
+}
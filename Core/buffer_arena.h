@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+// The memory of the streaming pipeline: ring blocks, fft buffers and
+// worker scratch. Large blocks get mappings of their own and small ones
+// are carved from shared chunks of normal pages, all 64 byte aligned.
+// Blocks of at least a huge page are on huge pages where the system has
+// them (transparent huge pages, or MAP_HUGETLB and large pages when they
+// are reserved), of the size it reports. A block can be locked in memory
+// and is faulted in when it is allocated, so streaming does not start
+// with page faults and TLB misses. The options are $SDDC_ARENA, a list
+// like "huge,prefault,lock" or "none"; huge pages and prefaulting by
+// default. Thread safe.
+class bufferArena {
+public:
+    enum {
+        HUGE_PAGES = 1,     // huge page backed mappings
+        PREFAULT = 2,       // touch every page when allocated
+        LOCK = 4,           // mlock / VirtualLock, needs RLIMIT_MEMLOCK
+    };
+
+    static const size_t ALIGNMENT = 64;
+
+    // for the following allocations
+    static void setFlags(unsigned flags);
+    static unsigned getFlags();
+
+    // size bytes, uninitialized; nullptr if out of memory
+    static void* alloc(size_t size);
+    static void free(void* ptr);
+
+    // the smallest block on huge pages, and their alignment; 0 without
+    static size_t getHugePageSize();
+
+    struct usage {
+        size_t mapped;      // bytes of all chunks and large blocks
+        size_t huge;        // of these, on huge pages or advised to be
+        size_t locked;      // of these, locked in memory
+        int blocks;         // live allocations
+    };
+    static usage getUsage();
+};
@@ -52,7 +52,7 @@ inline void null_func(const char *format, ...) { }
 #define	QUEUE_SIZE 32
 #define WIDEFFTN  // test FFTN 8192 
 
-#define FFTN_R_ADC (8192)       // FFTN used for ADC real stream DDC  tested at  2048, 8192, 32768, 131072
+#define FFTN_R_ADC (8192)       // default FFTN used for ADC real stream DDC, 2048 .. 65536 see fft_mt_r2iq::setFftSize()
 
 // GAINFACTORS to be adjusted with lab reference source measured with HDSDR Smeter rms mode  
 #define BBRF103_GAINFACTOR 	(7.8e-8f)       // BBRF103
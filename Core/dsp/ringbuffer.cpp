@@ -0,0 +1,51 @@
+#include "../license.txt"
+
+#include "ringbuffer.h"
+
+#include <stdint.h>
+#include <limits.h>
+#if defined(_WIN32)
+	#include <windows.h>    // WaitOnAddress, Synchronization.lib
+#elif defined(__linux__)
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+// the counts are waited on as the 32 bit words they are
+static_assert(sizeof(std::atomic<unsigned>) == sizeof(uint32_t), "a count is not a futex word");
+static_assert(std::atomic<unsigned>::is_always_lock_free, "a count is not a futex word");
+
+#if !defined(_WIN32) && !defined(__linux__)
+namespace {
+	// one for all rings: the sides sleep rarely, and wake all to check
+	std::mutex waitMutex;
+	std::condition_variable waitCV;
+}
+#endif
+
+void ringbufferbase::wait(std::atomic<unsigned>& count, unsigned seen)
+{
+#if defined(_WIN32)
+	WaitOnAddress(&count, &seen, sizeof(seen), INFINITE);
+#elif defined(__linux__)
+	syscall(SYS_futex, (uint32_t*)&count, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+#else
+	std::unique_lock<std::mutex> lk(waitMutex);
+	if (count.load() == seen)
+		waitCV.wait(lk);
+#endif
+}
+
+void ringbufferbase::wake(std::atomic<unsigned>& count)
+{
+#if defined(_WIN32)
+	WakeByAddressAll(&count);
+#elif defined(__linux__)
+	syscall(SYS_futex, (uint32_t*)&count, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+	(void)count;
+	std::unique_lock<std::mutex> lk(waitMutex);
+	waitCV.notify_all();
+#endif
+}
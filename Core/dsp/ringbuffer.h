@@ -1,122 +1,180 @@
 #pragma once
 
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <new>
+#include "../buffer_arena.h"
 
 const int default_count = 64;
 const int spin_count = 100;
-#define ALIGN (8)
-
+#define ALIGN (64)  // alignment of the blocks in bytes, for SIMD and fft plans; see bufferArena
+
+// A ring of blocks between one writer and one reader. The blocks written
+// and read are counted in atomics of their own cache lines, the low bits
+// are the indices of the ring, which has a power of two blocks. Handing a
+// block over is one atomic add; a side waits by spinning a little, then
+// sleeps on the other side's count (a futex, WaitOnAddress on Windows),
+// and is woken only if it sleeps. A pool of threads may share one side
+// when they hand over in order, see getReadPtrAt() and getWritePtrAt().
 class ringbufferbase {
 public:
     ringbufferbase(int count) :
-        max_count(count),
-        read_index(0),
-        write_index(0),
+        max_count(roundCount(count)),
+        mask(max_count - 1),
+        read_count(0),
+        write_count(0),
+        writeCount(0),
+        emptyWaiting(0),
+        fullWaiting(0),
         emptyCount(0),
         fullCount(0),
-        writeCount(0)
+        stopCount(0)
     {
     }
 
-    int getFullCount() const { return fullCount; }
+    int getFullCount() const { return fullCount.load(std::memory_order_relaxed); }
+
+    int getEmptyCount() const { return emptyCount.load(std::memory_order_relaxed); }
+
+    int getWriteCount() const { return writeCount.load(std::memory_order_relaxed); }
+
+    int getReadIndex() const { return read_count.load(std::memory_order_acquire) & mask; }
 
-    int getEmptyCount() const { return emptyCount; }
+    int getWriteIndex() const { return write_count.load(std::memory_order_acquire) & mask; }
 
-    int getWriteCount() const { return writeCount; }
+    int nextIndex(int index) const { return (index + 1) & mask; }
+
+    int getStopCount() const { return stopCount.load(std::memory_order_acquire); }
+
+    // for a writer which must not wait in getWritePtr()
+    bool isFull() const { return filled() >= max_count - 1; }
 
     void ReadDone()
     {
-        std::unique_lock<std::mutex> lk(mutex);
-        if ((write_index + 1) % max_count == read_index)
-        {
-            read_index = (read_index + 1) % max_count;
-            nonfullCV.notify_all();
-        }
-        else
-        {
-            read_index = (read_index + 1) % max_count;
-        }
+        read_count.fetch_add(1);
+        if (fullWaiting.load() != 0 && fullWaiting.exchange(0) != 0)
+            wake(read_count);
     }
 
     void WriteDone()
     {
-        std::unique_lock<std::mutex> lk(mutex);
-        if (read_index == write_index)
-        {
-            write_index = (write_index + 1) % max_count;
-            nonemptyCV.notify_all();
-        }
-        else
-        {
-            write_index = (write_index + 1) % max_count;
-        }
-        writeCount++;
+        writeCount.store(writeCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        write_count.fetch_add(1);
+        if (emptyWaiting.load() != 0 && emptyWaiting.exchange(0) != 0)
+            wake(write_count);
     }
 
+    // releases the waiting threads: the ring is half full, from index 0
+    // on. Both counts move on, a side which is about to sleep sees it
     void Stop()
     {
-        std::unique_lock<std::mutex> lk(mutex);
-        read_index = 0;
-        write_index = max_count / 2;
-        nonfullCV.notify_all();
-        nonemptyCV.notify_all();
+        stopCount.fetch_add(1);
+        const unsigned start = (write_count.load() | mask) + 1;
+        read_count.store(start);
+        write_count.store(start + max_count / 2);
+        wake(read_count);
+        wake(write_count);
     }
 
 protected:
 
     void WaitUntilNotEmpty()
     {
-        // if not empty
-        for (int i = 0; i < spin_count; i++)
-        {
-            if (read_index != write_index)
-                return;
-        }
+        waitFor(write_count, emptyWaiting, emptyCount, [this] {
+            return filled() != 0;
+        });
+    }
 
-        if (read_index == write_index)
-        {
-            std::unique_lock<std::mutex> lk(mutex);
+    void WaitUntilNotFull()
+    {
+        waitFor(read_count, fullWaiting, fullCount, [this] {
+            return filled() < max_count - 1;
+        });
+    }
 
-            emptyCount++;
-            nonemptyCV.wait(lk, [this] {
-                return read_index != write_index;
-            });
-        }
+    // The following two waits allow a pool of threads to work on several
+    // blocks at the same time: 'index' is a block slot ahead of the
+    // read/write index, which may move on while waiting, as long as the
+    // blocks are committed in order with ReadDone()/WriteDone().
+    // Both return early once Stop() was called after the pool read
+    // getStopCount() into 'stops'.
+    void WaitUntilFilled(int index, int stops)
+    {
+        waitFor(write_count, emptyWaiting, emptyCount, [this, index, stops] {
+            const int read_index = getReadIndex();
+            return stops != getStopCount() ||
+                distance(read_index, index) < distance(read_index, getWriteIndex());
+        });
     }
 
-    void WaitUntilNotFull()
+    void WaitUntilFree(int index, int stops)
+    {
+        waitFor(read_count, fullWaiting, fullCount, [this, index, stops] {
+            const int write_index = getWriteIndex();
+            return stops != getStopCount() ||
+                distance(getReadIndex(), write_index) + distance(write_index, index) < max_count - 1;
+        });
+    }
+
+    int distance(int from, int to) const { return (to - from) & mask; }
+
+    // the blocks written and not read yet
+    int filled() const
+    {
+        return (int)(write_count.load(std::memory_order_acquire) - read_count.load(std::memory_order_acquire));
+    }
+
+    const int max_count;
+    const unsigned mask;
+
+private:
+    static int roundCount(int count)
+    {
+        int n = 2;
+        while (n < count)
+            n *= 2;
+        return n;
+    }
+
+    // until ready(), sleeping on 'count' of the other side. A side sets
+    // 'waiting' before it looks at the count, the other side sees it after
+    // its add and wakes it, once per sleep
+    template<typename Ready> void waitFor(std::atomic<unsigned>& count, std::atomic<int>& waiting,
+        std::atomic<int>& waits, Ready ready)
     {
         for (int i = 0; i < spin_count; i++)
         {
-            if ((write_index + 1) % max_count != read_index)
+            if (ready())
                 return;
         }
 
-        if ((write_index + 1) % max_count == read_index)
+        waits.fetch_add(1, std::memory_order_relaxed);
+        for (;;)
         {
-            std::unique_lock<std::mutex> lk(mutex);
-            fullCount++;
-            nonfullCV.wait(lk, [this] {
-                return (write_index + 1) % max_count != read_index;
-            });
+            waiting.store(1);
+            const unsigned seen = count.load();
+            if (ready())
+                return;
+            wait(count, seen);
         }
     }
 
-    int max_count;
-
-    volatile int read_index;
-    volatile int write_index;
-
-private:
-    int emptyCount;
-    int fullCount;
-    int writeCount;
-
-    std::mutex mutex;
-    std::condition_variable nonemptyCV;
-    std::condition_variable nonfullCV;
+    // sleeps while 'count' is 'seen', or until woken
+    static void wait(std::atomic<unsigned>& count, unsigned seen);
+    static void wake(std::atomic<unsigned>& count);
+
+    // each on a cache line of its own: the reader's and the writer's
+    // counts and what the waiting sides change
+    alignas(ALIGN) std::atomic<unsigned> read_count;
+    alignas(ALIGN) std::atomic<unsigned> write_count;
+    std::atomic<int> writeCount;
+    alignas(ALIGN) std::atomic<int> emptyWaiting;
+    std::atomic<int> fullWaiting;
+    std::atomic<int> emptyCount;
+    std::atomic<int> fullCount;
+    std::atomic<int> stopCount;
 };
 
 template<typename T> class ringbuffer : public ringbufferbase {
@@ -124,7 +182,8 @@ template<typename T> class ringbuffer : public ringbufferbase {
 
 public:
     ringbuffer(int count = default_count) :
-        ringbufferbase(count)
+        ringbufferbase(count),
+        block_size(0)
     {
         buffers = new TPtr[max_count];
         buffers[0] = nullptr;
@@ -132,8 +191,7 @@ public:
 
     ~ringbuffer()
     {
-        if (buffers[0])
-            delete[] buffers[0];
+        bufferArena::free(buffers[0]);
 
         delete[] buffers;
     }
@@ -144,12 +202,15 @@ public:
         {
             block_size = size;
 
-            if (buffers[0])
-                delete[] buffers[0];
+            bufferArena::free(buffers[0]);
 
-            int aligned_block_size = (block_size + ALIGN - 1) & (~(ALIGN - 1));
+            int aligned_block_size = ((block_size * sizeof(T) + ALIGN - 1) & (~(ALIGN - 1))) / sizeof(T);
 
-            auto data = new T[max_count * aligned_block_size];
+            // all blocks in one allocation, faulted in now rather than
+            // while streaming
+            auto data = static_cast<T*>(bufferArena::alloc(sizeof(T) * max_count * aligned_block_size));
+            if (data == nullptr)
+                throw std::bad_alloc();
 
             for (int i = 0; i < max_count; ++i)
             {
@@ -160,26 +221,43 @@ public:
 
     T* peekWritePtr(int offset)
     {
-        return buffers[(write_index + max_count + offset) % max_count];
+        return buffers[(getWriteIndex() + offset) & mask];
     }
 
     T* peekReadPtr(int offset)
     {
-        return buffers[(read_index + max_count + offset) % max_count];
+        return buffers[(getReadIndex() + offset) & mask];
+    }
+
+    T* peekPtr(int index)
+    {
+        return buffers[index & mask];
+    }
+
+    T* getWritePtrAt(int index, int stops)
+    {
+        WaitUntilFree(index, stops);
+        return buffers[index];
+    }
+
+    const T* getReadPtrAt(int index, int stops)
+    {
+        WaitUntilFilled(index, stops);
+        return buffers[index];
     }
 
     T* getWritePtr()
     {
         // if there is still space
         WaitUntilNotFull();
-        return buffers[(write_index) % max_count];
+        return buffers[getWriteIndex()];
     }
 
     const T* getReadPtr()
     {
         WaitUntilNotEmpty();
 
-        return buffers[read_index];
+        return buffers[getReadIndex()];
     }
 
     int getBlockSize() const { return block_size; }
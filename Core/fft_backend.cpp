@@ -0,0 +1,46 @@
+#include "license.txt"
+
+#include "fft_backend.h"
+#include "buffer_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void* fftAlloc(size_t size)
+{
+	return bufferArena::alloc(size);
+}
+
+void fftFree(void* ptr)
+{
+	bufferArena::free(ptr);
+}
+
+const fftBackend* const* fftBackendList()
+{
+	static const fftBackend* const list[] = {
+#ifndef NO_FFTW
+		&fftBackend_fftw,
+#endif
+		&fftBackend_pffft,
+		nullptr
+	};
+	return list;
+}
+
+const fftBackend* fftBackendFind(const char* name)
+{
+	if (name == nullptr || name[0] == 0)
+	{
+		name = getenv("SDDC_FFT_BACKEND");
+		if (name == nullptr || name[0] == 0)
+			return fftBackendList()[0];
+	}
+
+	for (auto list = fftBackendList(); *list != nullptr; list++)
+	{
+		if (strcmp((*list)->name(), name) == 0)
+			return *list;
+	}
+	return nullptr;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+
+// FFT implementations of the DDC: FFTW (unless built with NO_FFTW) and
+// pffft, the portable one. Plans are made once and executed by all worker
+// threads on their own buffers; the input of a transform may be destroyed.
+
+typedef float fftComplex[2];
+
+// buffers for the transforms, aligned for any SIMD unit; from bufferArena
+void* fftAlloc(size_t size);
+void fftFree(void* ptr);
+
+// real to complex forward transform of n samples into n / 2 + 1 bins
+class fftR2c {
+public:
+    virtual ~fftR2c() {}
+    virtual void execute(float* in, fftComplex* out) = 0;
+};
+
+// complex transform of n samples, unnormalized like FFTW
+class fftC2c {
+public:
+    virtual ~fftC2c() {}
+    virtual void execute(fftComplex* in, fftComplex* out) = 0;
+    // whether it can execute into this buffer rather than the planned one
+    virtual bool accepts(const fftComplex* out) const { return true; }
+};
+
+class fftBackend {
+public:
+    virtual ~fftBackend() {}
+    virtual const char* name() const = 0;
+
+    // the plans of one r2iq setup are made between these, for its fft
+    // size: a backend may keep what it learns per size (FFTW wisdom)
+    virtual void beginPlans(int fftSize) const {}
+    virtual void endPlans(int fftSize) const {}
+
+    // the buffers show the alignment and placement of the executions
+    virtual fftR2c* planR2c(int n, float* in, fftComplex* out) const = 0;
+    virtual fftC2c* planC2c(int n, fftComplex* in, fftComplex* out, bool forward) const = 0;
+};
+
+extern const fftBackend& fftBackend_pffft;
+#ifndef NO_FFTW
+extern const fftBackend& fftBackend_fftw;
+#endif
+
+// the backends of this build, the default first; null terminated
+const fftBackend* const* fftBackendList();
+
+// backend by name, nullptr for the default: $SDDC_FFT_BACKEND or else the
+// first one of the list. Returns nullptr for an unknown name
+const fftBackend* fftBackendFind(const char* name);
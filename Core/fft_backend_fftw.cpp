@@ -0,0 +1,106 @@
+#include "license.txt"
+
+#ifndef NO_FFTW
+
+#include "fft_backend.h"
+#include "fftw_wisdom.h"
+#include "config.h"
+
+namespace {
+
+class fftwR2c : public fftR2c {
+public:
+	fftwR2c(fftwf_plan plan) : plan(plan) {}
+	~fftwR2c() { fftwf_destroy_plan(plan); }
+
+	void execute(float* in, fftComplex* out) override
+	{
+		fftwf_execute_dft_r2c(plan, in, out);
+	}
+
+private:
+	fftwf_plan plan;
+};
+
+class fftwC2c : public fftC2c {
+public:
+	fftwC2c(fftwf_plan plan, const fftComplex* out) : plan(plan), alignment(fftwf_alignment_of((float*)out)) {}
+	~fftwC2c() { fftwf_destroy_plan(plan); }
+
+	void execute(fftComplex* in, fftComplex* out) override
+	{
+		fftwf_execute_dft(plan, in, out);
+	}
+
+	// the new-array execution needs the alignment of the planned buffers
+	bool accepts(const fftComplex* out) const override
+	{
+		return fftwf_alignment_of((float*)out) == alignment;
+	}
+
+private:
+	fftwf_plan plan;
+	int alignment;
+};
+
+class fftwBackend : public fftBackend {
+public:
+	const char* name() const override { return "fftw"; }
+
+	// measured once per cpu model and size, see fftwWisdom; the wisdom
+	// in memory is the size's only, which is what endPlans() saves
+	void beginPlans(int fftSize) const override
+	{
+		fftwf_forget_wisdom();
+		cached = fftwWisdom::load(fftSize);
+		missed = false;
+		planner = cached ? (fftwWisdom::getPlanner() | FFTW_WISDOM_ONLY) : fftwWisdom::getPlanner();
+	}
+
+	void endPlans(int fftSize) const override
+	{
+		if (!cached || missed)
+			fftwWisdom::save(fftSize);
+	}
+
+	fftR2c* planR2c(int n, float* in, fftComplex* out) const override
+	{
+		fftwf_plan plan = fftwf_plan_dft_r2c_1d(n, in, out, planner);
+		if (wisdomMiss(plan, "r2c", n))
+			plan = fftwf_plan_dft_r2c_1d(n, in, out, fftwWisdom::getPlanner());
+		return new fftwR2c(plan);
+	}
+
+	fftC2c* planC2c(int n, fftComplex* in, fftComplex* out, bool forward) const override
+	{
+		const int sign = forward ? FFTW_FORWARD : FFTW_BACKWARD;
+		fftwf_plan plan = fftwf_plan_dft_1d(n, in, out, sign, planner);
+		if (wisdomMiss(plan, forward ? "c2c forward" : "c2c backward", n))
+			plan = fftwf_plan_dft_1d(n, in, out, sign, fftwWisdom::getPlanner());
+		return new fftwC2c(plan, out);
+	}
+
+private:
+	// a problem which is not in the cached wisdom is measured like
+	// without a cache, and the wisdom saved again with it
+	bool wisdomMiss(fftwf_plan plan, const char *name, int size) const
+	{
+		if (plan != nullptr)
+			return false;
+		DbgPrintf("fft wisdom has no %s %d plan, measured\n", name, size);
+		missed = true;
+		return true;
+	}
+
+	mutable bool cached = false;
+	mutable bool missed = false;
+	mutable unsigned planner = FFTW_MEASURE;
+};
+
+const fftwBackend backend;
+
+}
+
+const fftBackend& fftBackend_fftw = backend;
+
+#endif
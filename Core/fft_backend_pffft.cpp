@@ -0,0 +1,103 @@
+#include "license.txt"
+/*
+Portable FFT for builds and machines without FFTW: pffft, the SSE/NEON
+FFTPACK of the pf_mixer project, vendored in pffft/. Its ordered output
+is the interleaved spectrum; the real one has the Nyquist bin in the
+imaginary part of bin 0, which moves to bin n / 2 for the FFTW layout.
+*/
+
+#include "fft_backend.h"
+#include "pffft/pffft.h"
+
+#include <stdint.h>
+
+namespace {
+
+// pffft needs a work area of n floats (2n complex) per transform; the
+// plans are shared by the workers, so it is one per thread, grown to the
+// largest size once
+float* workBuffer(int size)
+{
+	struct scratchBuffer {
+		float* data = nullptr;
+		int size = 0;
+		~scratchBuffer() { fftFree(data); }
+	};
+	static thread_local scratchBuffer scratch;
+	if (scratch.size < size)
+	{
+		fftFree(scratch.data);
+		scratch.data = (float*)fftAlloc(sizeof(float) * size);
+		scratch.size = size;
+	}
+	return scratch.data;
+}
+
+bool isAligned(const void* ptr)
+{
+	return ((uintptr_t)ptr & 15) == 0;
+}
+
+class pffftR2c : public fftR2c {
+public:
+	pffftR2c(int n) : n(n), setup(pffft_new_setup(n, PFFFT_REAL)) {}
+	~pffftR2c() { pffft_destroy_setup(setup); }
+
+	void execute(float* in, fftComplex* out) override
+	{
+		float* bins = (float*)out;
+		pffft_transform_ordered(setup, in, bins, workBuffer(n), PFFFT_FORWARD);
+		bins[n] = bins[1];
+		bins[n + 1] = 0.0f;
+		bins[1] = 0.0f;
+	}
+
+private:
+	int n;
+	PFFFT_Setup* setup;
+};
+
+class pffftC2c : public fftC2c {
+public:
+	pffftC2c(int n, bool forward) : n(n), direction(forward ? PFFFT_FORWARD : PFFFT_BACKWARD), setup(pffft_new_setup(n, PFFFT_COMPLEX)) {}
+	~pffftC2c() { pffft_destroy_setup(setup); }
+
+	void execute(fftComplex* in, fftComplex* out) override
+	{
+		pffft_transform_ordered(setup, (float*)in, (float*)out, workBuffer(2 * n), direction);
+	}
+
+	// the SIMD loads and stores need 16 byte alignment
+	bool accepts(const fftComplex* out) const override
+	{
+		return isAligned(out);
+	}
+
+private:
+	int n;
+	pffft_direction_t direction;
+	PFFFT_Setup* setup;
+};
+
+class pffftBackend : public fftBackend {
+public:
+	const char* name() const override { return "pffft"; }
+
+	// n is 2^a 3^b 5^c, from 32 (real) or 16 (complex) on, see
+	// pffft_is_valid_size(): the r2iq sizes are powers of two above these
+	fftR2c* planR2c(int n, float* in, fftComplex* out) const override
+	{
+		return new pffftR2c(n);
+	}
+
+	fftC2c* planC2c(int n, fftComplex* in, fftComplex* out, bool forward) const override
+	{
+		return new pffftC2c(n, forward);
+	}
+};
+
+const pffftBackend backend;
+
+}
+
+const fftBackend& fftBackend_pffft = backend;
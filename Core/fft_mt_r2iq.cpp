@@ -14,12 +14,14 @@ The name r2iq as Real 2 I+Q stream
 
 #include "fft_mt_r2iq.h"
 #include "config.h"
-#include "fftw3.h"
+#include "fft_backend.h"
 #include "RadioHandler.h"
 
 #include "fir.h"
+#include "thread_placement.h"
 
 #include <assert.h>
+#include <array>
 #include <utility>
 
 
@@ -29,30 +31,114 @@ r2iqControlClass::r2iqControlClass()
 	randADC = false;
 	sideband = false;
 	mdecimation = 0;
+	resampleInterp = 1;
+	resampleDecim = 1;
 	mratio[0] = 1;  // 1,2,4,8,16
-	for (int i = 1; i < NDECIDX; i++)
+	for (int i = 1; i < NDECIMATE; i++)
 	{
 		mratio[i] = mratio[i - 1] * 2;
 	}
+	getAdcStats(true);
+}
+
+void adcStats::add(const adcStats& other)
+{
+	samples += other.samples;
+	clipped += other.clipped;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	for (int n = 0; n < ADC_LEVELS; n++)
+		levels[n] += other.levels[n];
+}
+
+// the reset takes each field at once, what the workers add meanwhile
+// counts for the next read
+adcStats r2iqControlClass::getAdcStats(bool reset)
+{
+	const adcStats empty;
+	adcStats stats;
+	if (reset)
+	{
+		stats.samples = adcSamples.exchange(0);
+		stats.clipped = adcClipped.exchange(0);
+		stats.min = (int16_t)adcMin.exchange(empty.min);
+		stats.max = (int16_t)adcMax.exchange(empty.max);
+		for (int n = 0; n < ADC_LEVELS; n++)
+			stats.levels[n] = adcLevels[n].exchange(0);
+	}
+	else
+	{
+		stats.samples = adcSamples.load();
+		stats.clipped = adcClipped.load();
+		stats.min = (int16_t)adcMin.load();
+		stats.max = (int16_t)adcMax.load();
+		for (int n = 0; n < ADC_LEVELS; n++)
+			stats.levels[n] = adcLevels[n].load();
+	}
+	return stats;
+}
+
+void r2iqControlClass::addAdcStats(const adcStats& stats)
+{
+	adcSamples.fetch_add(stats.samples, std::memory_order_relaxed);
+	adcClipped.fetch_add(stats.clipped, std::memory_order_relaxed);
+	for (int n = 0; n < ADC_LEVELS; n++)
+		adcLevels[n].fetch_add(stats.levels[n], std::memory_order_relaxed);
+	// a reset may come in between
+	int value = adcMin.load(std::memory_order_relaxed);
+	while (stats.min < value && !adcMin.compare_exchange_weak(value, stats.min, std::memory_order_relaxed))
+		;
+	value = adcMax.load(std::memory_order_relaxed);
+	while (stats.max > value && !adcMax.compare_exchange_weak(value, stats.max, std::memory_order_relaxed))
+		;
 }
 
 fft_mt_r2iq::fft_mt_r2iq() :
 	r2iqControlClass(),
-	filterHw(nullptr)
+	threadsConfig(0),
+	fftSizeConfig(FFTN_R_ADC),
+	halfFft(FFTN_R_ADC / 2),
+	overlap(0),
+	spectrumConfig(nullptr),
+	spectrumBinsConfig(0),
+	spectrumBlocksConfig(1),
+	spectrumRing(nullptr),
+	filterHw(nullptr),
+	backendConfig(fftBackendFind(nullptr)),
+	backend(nullptr),
+	processor_count(0)
 {
-	mtunebin = halfFft / 4;
-	mfftdim[0] = halfFft;
-	for (int i = 1; i < NDECIDX; i++)
+	// a bad $SDDC_R2IQ_KERNELS runs the default ones
+	kernelsConfig = r2iqKernelFind(nullptr);
+	if (kernelsConfig == nullptr)
+		kernelsConfig = r2iqKernelList()[0];
+	worker = workerOf(kernelsConfig);
+
+	for (int t = 0; t < N_MAX_R2IQ_THREADS; t++)
+		threadArgs[t] = nullptr;
+	for (int d = 0; d < NDECIDX; d++)
+		filterTaps[d] = 0;
+
+	for (int c = 0; c < N_MAX_R2IQ_CHANNELS; c++)
 	{
-		mfftdim[i] = mfftdim[i - 1] / 2;
+		channels[c].outputbuffer = nullptr;
+		channels[c].active = false;
+		channels[c].interp = 1;
+		channels[c].decim = 1;
+		channels[c].next.set = false;
+		channels[c].tunebin = 0;
+		channels[c].phase = 0.0;
 	}
+	channels[0].decimate = 0;
+	channels[0].lsb = false;
+	tuneChannel(channels[0], 0.25f);
 	GainScale = 0.0f;
 
 #ifndef NDEBUG
 	int mratio = 1;  // 1,2,4,8,16,..
 	const float Astop = 120.0f;
 	const float relPass = 0.85f;  // 85% of Nyquist should be usable
-	const float relStop = 1.1f;   // 'some' alias back into transition band is OK
+	const float relStop = 1.0f;   // the bins beyond Nyquist are cut off, the filter must be down there
 	printf("\n***************************************************************************\n");
 	printf("Filter tap estimation, Astop = %.1f dB, relPass = %.2f, relStop = %.2f\n", Astop, relPass, relStop);
 	for (int d = 0; d < NDECIDX; d++)
@@ -70,64 +156,415 @@ fft_mt_r2iq::fft_mt_r2iq() :
 
 fft_mt_r2iq::~fft_mt_r2iq()
 {
+	freeFft();
+}
+
+void fft_mt_r2iq::freeFft()
+{
+	for (unsigned t = 0; t < N_MAX_R2IQ_THREADS; t++) {
+		auto th = threadArgs[t];
+		if (th == nullptr)
+			continue;
+		fftFree(th->ADCinTime);
+		fftFree(th->ADCinFreq);
+		fftFree(th->inFreqTmp);
+		fftFree(th->outTimeTmp);
+		fftFree(th->staging);
+		fftFree(th->power);
+
+		delete threadArgs[t];
+		threadArgs[t] = nullptr;
+	}
+
 	if (filterHw == nullptr)
 		return;
 
-	fftwf_export_wisdom_to_filename("wisdom");
-
 	for (int d = 0; d < NDECIDX; d++)
 	{
-		fftwf_free(filterHw[d]);     // 4096
+		fftFree(filterHw[d]);     // halfFft
 	}
-	fftwf_free(filterHw);
+	fftFree(filterHw);
+	filterHw = nullptr;
 
-	fftwf_destroy_plan(plan_t2f_r2c);
+	delete plan_t2f_r2c;
 	for (int d = 0; d < NDECIDX; d++)
 	{
-		fftwf_destroy_plan(plans_f2t_c2c[d]);
+		delete plans_f2t_c2c[d];
+		delete plans_f2t_c2c_lsb[d];
 	}
+}
 
-	for (unsigned t = 0; t < processor_count; t++) {
-		auto th = threadArgs[t];
-		fftwf_free(th->ADCinTime);
-		fftwf_free(th->ADCinFreq);
-		fftwf_free(th->inFreqTmp);
+bool fft_mt_r2iq::setFftSize(int size)
+{
+	if (size < FFTN_R_ADC_MIN || size > FFTN_R_ADC_MAX || (size & (size - 1)) != 0)
+		return false;
 
-		delete threadArgs[t];
+	this->fftSizeConfig = size;
+	return true;
+}
+
+bool fft_mt_r2iq::setSpectrum(ringbuffer<float>* ring, int bins, int blocksPerFrame)
+{
+	if (ring != nullptr && (bins < 1 || bins > FFTN_R_ADC_MAX / 2 || (bins & (bins - 1)) != 0 || blocksPerFrame < 1))
+		return false;
+
+	this->spectrumConfig = ring;
+	this->spectrumBinsConfig = bins;
+	this->spectrumBlocksConfig = blocksPerFrame;
+	return true;
+}
+
+// the blocks come in order, a frame is complete after spectrumBlocks of them
+void fft_mt_r2iq::addSpectrum(const float* power, int segments)
+{
+	for (int k = 0; k < halfFft; k++)
+		spectrumSum[k] += power[k];
+	spectrumSegments += segments;
+	if (++spectrumCount < spectrumBlocks)
+		return;
+
+	if (!spectrumRing->isFull())
+	{
+		// a full scale sine peaks at 32768 * 2 * halfFft / 4 in the
+		// windowed fft, 1.5 bins is the noise bandwidth of the window
+		const double peak = 32768.0 * halfFft / 2.0;
+		const float scale = (float)(1.0 / (1.5 * peak * peak * spectrumSegments));
+		const int step = halfFft / spectrumBins;
+		float* frame = spectrumRing->getWritePtr();
+		for (int b = 0; b < spectrumBins; b++)
+		{
+			float sum = 0.0f;
+			for (int k = b * step; k < (b + 1) * step; k++)
+				sum += spectrumSum[k];
+			frame[b] = sum * scale;
+		}
+		spectrumRing->WriteDone();
 	}
+	std::fill(spectrumSum.begin(), spectrumSum.end(), 0.0f);
+	spectrumCount = 0;
+	spectrumSegments = 0;
 }
 
+bool fft_mt_r2iq::setFftBackend(const char* name)
+{
+	auto backend = fftBackendFind(name);
+	if (backend == nullptr)
+		return false;
+
+	this->backendConfig = backend;
+	return true;
+}
 
-float fft_mt_r2iq::setFreqOffset(float offset)
+
+void fft_mt_r2iq::tuneChannel(r2iqChannel& ch, float offset)
 {
 	// align to 1/4 of halfft
-	this->mtunebin = int(offset * halfFft / 4) * 4;  // mtunebin step 4 bin  ?
-	float delta = ((float)this->mtunebin  / halfFft) - offset;
-	float ret = delta * getRatio(); // ret increases with higher decimation
-	DbgPrintf("offset %f mtunebin %d delta %f (%f)\n", offset, this->mtunebin, delta, ret);
-	return ret;
+	const int previous = ch.tunebin;
+	ch.offset = offset;
+	ch.tunebin = int(offset * halfFft / 4) * 4;  // mtunebin step 4 bin  ?
+	float delta = ((float)ch.tunebin / halfFft) - offset;
+	ch.fine = delta * mratio[fftDecimate(ch.decimate)]; // increases with higher decimation
+	if (ch.lsb)
+		ch.fine = -ch.fine;   // sign change with sideband used
+
+	// the output phase continues: the fine tuning takes over the step of
+	// the whole bin oscillator (see binPhase()) at output sample 0 of the
+	// next block. That is ADC sample -overlap of it, which the filter
+	// centered taps + 1 samples ahead mixed
+	const int at = filterTaps[fftDecimate(ch.decimate)] + 1 - overlap;
+	const float step = binPhase(ch.tunebin, at, ch.lsb) - binPhase(previous, at, ch.lsb);
+	ch.phase -= step / (2.0 * 3.14159265358979323846);
+	ch.phase -= floor(ch.phase);
+}
+
+float fft_mt_r2iq::setFreqOffset(float offset)
+{
+	std::unique_lock<std::mutex> lk(mutexTune);
+	tuneChannel(channels[0], offset);
+	DbgPrintf("offset %f mtunebin %d fine %f\n", offset, channels[0].tunebin, channels[0].fine);
+	return 0.0f;
+}
+
+int fft_mt_r2iq::addChannel(ringbuffer<float>* obuffers, int decimate, bool lsb, int interp, int decim, const r2iqOutputFormat& format)
+{
+	if (decimate < 0 || decimate >= NDECIMATE)
+		return -1;
+	if (interp < 1 || interp > decim || interp > RESAMPLE_MAX_INTERP)
+		return -1;
+
+	std::unique_lock<std::mutex> lk(mutexR2iqControl);
+	for (int c = 1; c < N_MAX_R2IQ_CHANNELS; c++)
+	{
+		auto &ch = channels[c];
+		if (ch.outputbuffer != nullptr)
+			continue;
+
+		ch.outputbuffer = obuffers;
+		ch.decimate = decimate;
+		ch.lsb = lsb;
+		ch.interp = interp;
+		ch.decim = decim;
+		ch.format = format;
+		{
+			std::unique_lock<std::mutex> lk(mutexTune);
+			tuneChannel(ch, 0.25f);
+		}
+		if (r2iqOn)
+			startChannel(ch);
+		DbgPrintf("r2iq: added channel %d, decimate %d\n", c, decimate);
+		return c;
+	}
+	return -1;
+}
+
+void fft_mt_r2iq::removeChannel(int channel)
+{
+	if (channel <= 0 || channel >= N_MAX_R2IQ_CHANNELS)
+		return;
+
+	uint64_t seq;
+	{
+		std::unique_lock<std::mutex> lk(mutexR2iqControl);
+		channels[channel].active = false;
+		seq = dispatchSeq;
+	}
+
+	if (r2iqOn)
+	{
+		// wait for the blocks already dispatched to the channel
+		std::unique_lock<std::mutex> lk(mutexCommit);
+		commitCV.wait(lk, [this, seq] { return this->commitSeq >= seq || !r2iqOn; });
+	}
+
+	std::unique_lock<std::mutex> lk(mutexR2iqControl);
+	channels[channel].outputbuffer = nullptr;
+}
+
+float fft_mt_r2iq::setChannelFreqOffset(int channel, float offset)
+{
+	if (channel == 0)
+		return setFreqOffset(offset);
+	if (channel < 0 || channel >= N_MAX_R2IQ_CHANNELS)
+		return 0.0f;
+
+	std::unique_lock<std::mutex> lk(mutexTune);
+	tuneChannel(channels[channel], offset);
+	return 0.0f;
+}
+
+bool fft_mt_r2iq::reconfigureChannel(int channel, int decimate, bool lsb, int interp, int decim)
+{
+	if (channel < 0 || channel >= N_MAX_R2IQ_CHANNELS)
+		return false;
+	if (decimate < 0 || decimate >= NDECIMATE)
+		return false;
+	if (interp < 1 || interp > decim || interp > RESAMPLE_MAX_INTERP)
+		return false;
+
+	std::unique_lock<std::mutex> lk(mutexR2iqControl);
+	auto &ch = channels[channel];
+	if (channel == 0)
+	{
+		// for the next TurnOn()
+		setDecimate(decimate);
+		setSideband(lsb);
+		setResample(interp, decim);
+	}
+	else if (ch.outputbuffer == nullptr)
+	{
+		return false;
+	}
+
+	if (ch.active)
+	{
+		ch.next.set = true;
+		ch.next.decimate = decimate;
+		ch.next.lsb = lsb;
+		ch.next.interp = interp;
+		ch.next.decim = decim;
+	}
+	else
+	{
+		ch.decimate = decimate;
+		ch.lsb = lsb;
+		ch.interp = interp;
+		ch.decim = decim;
+	}
+	return true;
+}
+
+// the previous blocks finish with the old settings, the half-band stages
+// and the resampler start over at the commit of this one
+void fft_mt_r2iq::switchChannel(r2iqChannel& ch, uint64_t seq)
+{
+	ch.decimate = ch.next.decimate;
+	ch.lsb = ch.next.lsb;
+	ch.interp = ch.next.interp;
+	ch.decim = ch.next.decim;
+	ch.next.set = false;
+	ch.commitFill = ch.commitFill || (ch.interp != ch.decim);
+	ch.firstSeq = seq;
+	tuneChannel(ch, ch.offset);
+	DbgPrintf("r2iq: channel %d switched to decimate %d, %s, resample %d / %d with block %llu\n",
+		(int)(&ch - channels), ch.decimate, ch.lsb ? "lsb" : "usb", ch.interp, ch.decim, (unsigned long long)seq);
+}
+
+void fft_mt_r2iq::startChannel(r2iqChannel& ch)
+{
+	ch.firstSeq = dispatchSeq;
+	ch.outIndex = ch.outputbuffer->getWriteIndex();
+	ch.outStops = ch.outputbuffer->getStopCount();
+	ch.outBlock = nullptr;
+	ch.outFill = 0;
+	ch.blockLen = ch.outputbuffer->getBlockSize() / ch.format.sampleBytes();
+	// a full scale ADC tone comes out at 32768 * 1024 * GainScale, see the
+	// filter gain in setupFft()
+	static const float fullScale[NFORMAT] = { 0.0f, 32767.0f, 127.0f, 1.0f };
+	ch.scale = ch.format.scale;
+	if (ch.scale == 0.0f)
+		ch.scale = (ch.format.format == FORMAT_CF32) ? 1.0f : fullScale[ch.format.format] / (32768.0f * 1024.0f * GainScale);
+	ch.phase = 0.0;
+	ch.commitFill = (ch.interp != ch.decim);
+	ch.next.set = false;
+	ch.cascade.init(ch.decimate - fftDecimate(ch.decimate), transferSamples >> (fftDecimate(ch.decimate) + 1));
+	ch.resampler.init(ch.interp, ch.decim);
+	ch.active = true;
+}
+
+// the resampled output fills the ring blocks in order, whatever it
+// brings per input block
+void fft_mt_r2iq::writeOutput(r2iqChannel& ch, const fftComplex* data, int count, r2iqStore store)
+{
+	const int blockLen = ch.blockLen;
+	while (count > 0)
+	{
+		if (ch.outFill == 0)
+		{
+			ch.outBlock = ch.outputbuffer->getWritePtrAt(ch.outIndex, ch.outStops);
+			ch.outIndex = ch.outputbuffer->nextIndex(ch.outIndex);
+		}
+		const int n = std::min(count, blockLen - ch.outFill);
+		store(ch.outBlock, blockLen, ch.outFill, data, n, ch.scale);
+		ch.outFill += n;
+		data += n;
+		count -= n;
+		if (ch.outFill == blockLen)
+		{
+			ch.outputbuffer->WriteDone();
+			ch.outFill = 0;
+		}
+	}
+}
+
+static r2iqThreadArg* allocThreadArg(int halfFft)
+{
+	r2iqThreadArg *th = new r2iqThreadArg();
+
+	th->ADCinTime = (float*)fftAlloc(sizeof(float) * 2 * halfFft);                 // 4096
+
+	th->ADCinFreq = (fftComplex*)fftAlloc(sizeof(fftComplex)*(halfFft + 1)); // 1024+1
+	th->inFreqTmp = (fftComplex*)fftAlloc(sizeof(fftComplex)*(halfFft));    // 1024
+	th->outTimeTmp = (fftComplex*)fftAlloc(sizeof(fftComplex)*(halfFft));   // 1024
+	th->staging = nullptr;     // grows with the channels
+	th->stagingSize = 0;
+	th->power = (float*)fftAlloc(sizeof(float) * halfFft);
+
+	return th;
 }
 
 void fft_mt_r2iq::TurnOn() {
+	// Get the processor count
+	// by default one worker per cpu of their placement
+	if (threadsConfig > 0)
+		processor_count = threadsConfig;
+	else if (threadCpuCount(THREAD_R2IQ) > 0)
+		processor_count = threadCpuCount(THREAD_R2IQ);
+	else
+		processor_count = std::thread::hardware_concurrency() - 1;
+	if (processor_count == 0)
+		processor_count = 1;
+	if (processor_count > N_MAX_R2IQ_THREADS)
+		processor_count = N_MAX_R2IQ_THREADS;
+	worker = workerOf(kernelsConfig);
+	DbgPrintf("r2iq: %u worker threads, %s kernels\n", processor_count, kernelsConfig->name);
+
+	if (getFftSize() != fftSizeConfig || backend != backendConfig)
+		setupFft();
+	for (unsigned t = 0; t < processor_count; t++) {
+		if (threadArgs[t] == nullptr)
+			threadArgs[t] = allocThreadArg(halfFft);
+	}
+
+	this->dispatchSeq = 0;
+	this->commitSeq = 0;
+	getAdcStats(true);
+	this->inIndex = inputbuffer->getReadIndex();
+
+	spectrumRing = spectrumConfig;
+	if (spectrumRing != nullptr && spectrumBinsConfig > halfFft)
+	{
+		DbgPrintf("r2iq: no spectrum of %d bins with fft size %d\n", spectrumBinsConfig, 2 * halfFft);
+		spectrumRing = nullptr;
+	}
+	spectrumBins = spectrumBinsConfig;
+	spectrumBlocks = spectrumBlocksConfig;
+	spectrumCount = 0;
+	spectrumSegments = 0;
+	spectrumSum.assign(spectrumRing != nullptr ? halfFft : 0, 0.0f);
+	this->inStops = inputbuffer->getStopCount();
+
+	// the main channel takes its settings from r2iqControlClass
+	channels[0].outputbuffer = outputbuffer;
+	channels[0].decimate = mdecimation;
+	channels[0].lsb = getSideband();
+	channels[0].interp = resampleInterp;
+	channels[0].decim = resampleDecim;
+	channels[0].format = outputFormat;
+	for (int c = 0; c < N_MAX_R2IQ_CHANNELS; c++)
+	{
+		if (channels[c].outputbuffer == nullptr)
+			continue;
+		{
+			std::unique_lock<std::mutex> lk(mutexTune);
+			tuneChannel(channels[c], channels[c].offset);  // with this decimation, sideband and fft size
+		}
+		startChannel(channels[c]);
+	}
 	this->r2iqOn = true;
-	this->bufIdx = 0;
-	this->lastThread = threadArgs[0];
 
 	for (unsigned t = 0; t < processor_count; t++) {
 		r2iq_thread[t] = std::thread(
-			[this] (void* arg)
-				{ return this->r2iqThreadf((r2iqThreadArg*)arg); }, (void*)threadArgs[t]);
+			[this, t] (void* arg)
+				{
+					char name[16];
+					snprintf(name, sizeof(name), "sddc-r2iq%u", t);
+					threadScope scope(THREAD_R2IQ, name);
+					return this->r2iqThreadf((r2iqThreadArg*)arg);
+				}, (void*)threadArgs[t]);
 	}
 }
 
 void fft_mt_r2iq::TurnOff(void) {
 	this->r2iqOn = false;
 
+	// the workers may wait on any of the rings holding mutexR2iqControl
 	inputbuffer->Stop();
-	outputbuffer->Stop();
+	for (int c = 0; c < N_MAX_R2IQ_CHANNELS; c++)
+	{
+		if (channels[c].active)
+			channels[c].outputbuffer->Stop();
+	}
+	if (spectrumRing != nullptr)
+		spectrumRing->Stop();
+	{
+		std::unique_lock<std::mutex> lk(mutexCommit);
+		commitCV.notify_all();
+	}
 	for (unsigned t = 0; t < processor_count; t++) {
 		r2iq_thread[t].join();
 	}
+	for (int c = 0; c < N_MAX_R2IQ_CHANNELS; c++)
+		channels[c].active = false;
 }
 
 bool fft_mt_r2iq::IsOn(void) { return(this->r2iqOn); }
@@ -139,78 +576,133 @@ void fft_mt_r2iq::Init(float gain, ringbuffer<int16_t> *input, ringbuffer<float>
 
 	this->GainScale = gain;
 
-	fftwf_import_wisdom_from_filename("wisdom");
+	setupFft();
+}
 
-	// Get the processor count
-	processor_count = std::thread::hardware_concurrency() - 1;
-	if (processor_count == 0)
-		processor_count = 1;
-	if (processor_count > N_MAX_R2IQ_THREADS)
-		processor_count = N_MAX_R2IQ_THREADS;
+void fft_mt_r2iq::setupFft()
+{
+	freeFft();
+
+	halfFft = fftSizeConfig / 2;
+	backend = backendConfig;
+	mfftdim[0] = halfFft;
+	for (int i = 1; i < NDECIDX; i++)
+	{
+		mfftdim[i] = mfftdim[i - 1] / 2;
+	}
 
+	// filters: as many taps as each decimation needs for Astop, up to
+	// halfFft / 2, the rate is halfFft bins. The longer ones of the higher
+	// decimations keep the attenuation with a wider transition band.
+	const float Astop = 120.0f;
+	const float relPass = 0.85f;  // 85% of Nyquist should be usable
+	const float relStop = 1.0f;   // the bins beyond Nyquist are cut off, the filter must be down there
+	const int maxTaps = halfFft / 2;
+	cascadeFrom = 0;
+	for (int d = 0; d < NDECIDX; d++)
 	{
-		fftwf_plan filterplan_t2f_c2c; // time to frequency fft
+		float Bw = 64.0f / mratio[d];
+		filterTaps[d] = KaiserWindow(-maxTaps, Astop, relPass * Bw / 128.0f, relStop * Bw / 128.0f, nullptr);
+		// a shortened filter leaves spurs in the narrow bands of the
+		// half-band stages
+		if (KaiserWindow(0, Astop, relPass * Bw / 128.0f, relStop * Bw / 128.0f, nullptr) <= maxTaps)
+			cascadeFrom = d;
+	}
 
-		DbgPrintf((char *) "r2iqCntrl initialization\n");
+	// output sample 0 of a block is ADC sample -overlap, early enough for
+	// the longest filter, which looks ahead 2 * taps ADC samples. A segment
+	// keeps what is not affected by the filters, 2 * halfFft - discard
+	// samples, in multiples of 4 output samples; the last one ends with the
+	// block. All layouts give the same output, with fewer segments for the
+	// short filters of the lower decimations.
+	const int blockSamples = (int)transferSamples;
+	const int maxUnit = 4 << NDECIDX;
+	overlap = 0;
+	for (int d = 0; d < NDECIDX; d++)
+		overlap = std::max(overlap, (2 * filterTaps[d] + maxUnit - 1) / maxUnit * maxUnit);
 
+	for (int d = 0; d < NDECIDX; d++)
+	{
+		const int unit = 4 << (d + 1);
+		int discard = 0;
+		for (int i = 0; i <= d; i++)
+			discard = std::max(discard, (2 * filterTaps[i] + unit - 1) / unit * unit);
+		const int step = 2 * halfFft - discard;
+
+		auto &layout = segments[d];
+		layout.clear();
+		int next = -overlap;  // ADC sample of the next output
+		int counted = -overlap;     // ADC statistics up to this sample
+		while (next < blockSamples - overlap)
+		{
+			r2iqSegment seg;
+			seg.start = std::min(next, blockSamples - 2 * halfFft);
+			seg.keep = next - seg.start;
+			seg.length = std::min(seg.start + step, blockSamples - overlap) - next;
+			seg.pos = next + overlap;
+			seg.direct = (seg.keep == 0 && seg.pos + 2 * halfFft <= blockSamples);
+			seg.statsEnd = std::min(2 * halfFft, blockSamples - overlap - seg.start);
+			seg.statsBegin = std::min(counted - seg.start, seg.statsEnd);
+			counted = seg.start + seg.statsEnd;
+			layout.push_back(seg);
+			next += seg.length;
+		}
+	}
 
-		//        DbgPrintf((char *) "RandTable generated\n");
+	{
+		DbgPrintf((char *) "r2iqCntrl initialization, %s fft %d\n", backend->name(), 2 * halfFft);
+		for (int d = 0; d < NDECIDX; d++)
+			DbgPrintf((char *) "decimation %d: %d taps, %d segments per block\n", d, filterTaps[d], (int)segments[d].size());
 
 		   // filters
-		fftwf_complex *pfilterht;       // time filter ht
-		pfilterht = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*halfFft);     // halfFft
-		filterHw = (fftwf_complex**)fftwf_malloc(sizeof(fftwf_complex*)*NDECIDX);
+		fftComplex *pfilterht;       // time filter ht
+		pfilterht = (fftComplex*)fftAlloc(sizeof(fftComplex)*halfFft);     // halfFft
+		filterHw = (fftComplex**)fftAlloc(sizeof(fftComplex*)*NDECIDX);
 		for (int d = 0; d < NDECIDX; d++)
 		{
-			filterHw[d] = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*halfFft);     // halfFft
+			filterHw[d] = (fftComplex*)fftAlloc(sizeof(fftComplex)*halfFft);     // halfFft
 		}
 
-		filterplan_t2f_c2c = fftwf_plan_dft_1d(halfFft, pfilterht, filterHw[0], FFTW_FORWARD, FFTW_MEASURE);
-		float *pht = new float[halfFft / 4 + 1];
-		const float Astop = 120.0f;
-		const float relPass = 0.85f;  // 85% of Nyquist should be usable
-		const float relStop = 1.1f;   // 'some' alias back into transition band is OK
+		backend->beginPlans(2 * halfFft);
+		fftC2c *filterplan_t2f_c2c = backend->planC2c(halfFft, pfilterht, filterHw[0], true); // time to frequency fft
+		float *pht = new float[maxTaps];
 		for (int d = 0; d < NDECIDX; d++)	// @todo when increasing NDECIDX
 		{
-			// @todo: have dynamic bandpass filter size - depending on decimation
-			//   to allow same stopband-attenuation for all decimations
 			float Bw = 64.0f / mratio[d];
 			// Bw *= 0.8f;  // easily visualize Kaiser filter's response
-			KaiserWindow(halfFft / 4 + 1, Astop, relPass * Bw / 128.0f, relStop * Bw / 128.0f, pht);
+			KaiserWindow(filterTaps[d], Astop, relPass * Bw / 128.0f, relStop * Bw / 128.0f, pht);
 
-			float gainadj = gain * 2048.0f / (float)FFTN_R_ADC; // reference is FFTN_R_ADC == 2048
+			float gainadj = GainScale * 2048.0f / (float)(2 * halfFft); // reference is FFTN_R_ADC == 2048
 
 			for (int t = 0; t < halfFft; t++)
 			{
 				pfilterht[t][0] = pfilterht[t][1]= 0.0F;
 			}
 		
-			for (int t = 0; t < (halfFft/4+1); t++)
+			for (int t = 0; t < filterTaps[d]; t++)
 			{
 				pfilterht[halfFft-1-t][0] = gainadj * pht[t];
 			}
 
-			fftwf_execute_dft(filterplan_t2f_c2c, pfilterht, filterHw[d]);
+			filterplan_t2f_c2c->execute(pfilterht, filterHw[d]);
 		}
 		delete[] pht;
-		fftwf_destroy_plan(filterplan_t2f_c2c);
-		fftwf_free(pfilterht);
-
-		for (unsigned t = 0; t < processor_count; t++) {
-			r2iqThreadArg *th = new r2iqThreadArg();
-			threadArgs[t] = th;
+		delete filterplan_t2f_c2c;
+		fftFree(pfilterht);
 
-			th->ADCinTime = (float*)fftwf_malloc(sizeof(float) * (halfFft + transferSize / 2));                 // 2048
+		// the plans are executed by all threads on their own buffers
+		if (threadArgs[0] == nullptr)
+			threadArgs[0] = allocThreadArg(halfFft);
 
-			th->ADCinFreq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(halfFft + 1)); // 1024+1
-			th->inFreqTmp = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*(halfFft));    // 1024
-		}
-
-		plan_t2f_r2c = fftwf_plan_dft_r2c_1d(2 * halfFft, threadArgs[0]->ADCinTime, threadArgs[0]->ADCinFreq, FFTW_MEASURE);
+		auto th = threadArgs[0];
+		plan_t2f_r2c = backend->planR2c(2 * halfFft, th->ADCinTime, th->ADCinFreq);
 		for (int d = 0; d < NDECIDX; d++)
 		{
-			plans_f2t_c2c[d] = fftwf_plan_dft_1d(mfftdim[d], threadArgs[0]->inFreqTmp, threadArgs[0]->inFreqTmp, FFTW_BACKWARD, FFTW_MEASURE);
+			// out of place, to execute it also into the output blocks
+			plans_f2t_c2c[d] = backend->planC2c(mfftdim[d], th->inFreqTmp, th->outTimeTmp, false);
+			plans_f2t_c2c_lsb[d] = backend->planC2c(mfftdim[d], th->inFreqTmp, th->outTimeTmp, true);
 		}
+		backend->endPlans(2 * halfFft);
 	}
 }
 
@@ -233,53 +725,125 @@ void fft_mt_r2iq::Init(float gain, ringbuffer<int16_t> *input, ringbuffer<float>
 		unsigned long caps = getauxval(AT_HWCAP);
 		return (caps & HWCAP_NEON);
 	}
+#elif defined(__aarch64__)
+	// Advanced SIMD is part of every ARMv8-A core
+	#define DETECT_NEON
+	static bool detect_neon()
+	{
+		return true;
+	}
 #else
 #error Compiler does not identify an x86 or ARM core..
 #endif
 
-void * fft_mt_r2iq::r2iqThreadf(r2iqThreadArg *th)
+#ifndef NO_SIMD_OPTIM
+struct hwCapabilities {
+	bool avx;
+	bool avx2;
+	bool avx512f;
+	bool neon;
+};
+
+static hwCapabilities detect_hw()
 {
-#ifdef NO_SIMD_OPTIM
-	DbgPrintf("Hardware Capability: all SIMD features (AVX, AVX2, AVX512) deactivated\n");
-	return r2iqThreadf_def(th);
-#else
+	hwCapabilities hw = { false, false, false, false };
 #if defined(DETECT_AVX)
 	int info[4];
-	bool HW_AVX = false;
-	bool HW_AVX2 = false;
-	bool HW_AVX512F = false;
 
 	cpuid(info, 0);
 	int nIds = info[0];
 
 	if (nIds >= 0x00000001){
 		cpuid(info,0x00000001);
-		HW_AVX    = (info[2] & ((int)1 << 28)) != 0;
+		hw.avx    = (info[2] & ((int)1 << 28)) != 0;
 	}
 	if (nIds >= 0x00000007){
 		cpuid(info,0x00000007);
-		HW_AVX2   = (info[1] & ((int)1 <<  5)) != 0;
+		hw.avx2   = (info[1] & ((int)1 <<  5)) != 0;
 
-		HW_AVX512F     = (info[1] & ((int)1 << 16)) != 0;
+		hw.avx512f     = (info[1] & ((int)1 << 16)) != 0;
 	}
+#elif defined(DETECT_NEON)
+	hw.neon = detect_neon();
+#endif
+	return hw;
+}
+#endif
 
-	DbgPrintf("Hardware Capability: AVX:%d AVX2:%d AVX512:%d\n", HW_AVX, HW_AVX2, HW_AVX512F);
+const r2iqKernels* const* r2iqKernelList()
+{
+	static const auto list = [] {
+		std::array<const r2iqKernels*, 6> l{};
+		int n = 0;
+#ifndef NO_SIMD_OPTIM
+		hwCapabilities hw = detect_hw();
+#if defined(DETECT_AVX)
+		if (hw.avx512f)
+			l[n++] = &r2iqKernels_avx512;
+		if (hw.avx2)
+			l[n++] = &r2iqKernels_avx2;
+		if (hw.avx)
+			l[n++] = &r2iqKernels_avx;
+#elif defined(DETECT_NEON)
+		if (hw.neon)
+			l[n++] = &r2iqKernels_neon;
+#endif
+#endif
+		l[n++] = &r2iqKernels_def;
+		l[n++] = &r2iqKernels_ref;
+		return l;
+	}();
+	return list.data();
+}
 
-	if (HW_AVX512F)
-		return r2iqThreadf_avx512(th);
-	else if (HW_AVX2)
-		return r2iqThreadf_avx2(th);
-	else if (HW_AVX)
-		return r2iqThreadf_avx(th);
-	else
-		return r2iqThreadf_def(th);
+const r2iqKernels* r2iqKernelFind(const char* name)
+{
+	if (name == nullptr || name[0] == 0)
+	{
+		name = getenv("SDDC_R2IQ_KERNELS");
+		if (name == nullptr || name[0] == 0)
+			return r2iqKernelList()[0];
+	}
+
+	for (auto list = r2iqKernelList(); *list != nullptr; list++)
+	{
+		if (strcmp((*list)->name, name) == 0)
+			return *list;
+	}
+	return nullptr;
+}
+
+fft_mt_r2iq::r2iqWorker fft_mt_r2iq::workerOf(const r2iqKernels* kernels)
+{
+	if (kernels == &r2iqKernels_ref)
+		return &fft_mt_r2iq::r2iqThreadf_ref;
+#ifndef NO_SIMD_OPTIM
+#if defined(DETECT_AVX)
+	if (kernels == &r2iqKernels_avx512)
+		return &fft_mt_r2iq::r2iqThreadf_avx512;
+	if (kernels == &r2iqKernels_avx2)
+		return &fft_mt_r2iq::r2iqThreadf_avx2;
+	if (kernels == &r2iqKernels_avx)
+		return &fft_mt_r2iq::r2iqThreadf_avx;
 #elif defined(DETECT_NEON)
-	bool NEON = detect_neon();
-	DbgPrintf("Hardware Capability: NEON:%d\n", NEON);
-	if (NEON)
-		return r2iqThreadf_neon(th);
-	else
-		return r2iqThreadf_def(th);
+	if (kernels == &r2iqKernels_neon)
+		return &fft_mt_r2iq::r2iqThreadf_neon;
 #endif
 #endif
+	return &fft_mt_r2iq::r2iqThreadf_def;
+}
+
+bool fft_mt_r2iq::setKernels(const char* name)
+{
+	auto kernels = r2iqKernelFind(name);
+	if (kernels == nullptr)
+		return false;
+
+	this->kernelsConfig = kernels;
+	return true;
+}
+
+void * fft_mt_r2iq::r2iqThreadf(r2iqThreadArg *th)
+{
+	return (this->*worker)(th);
 }
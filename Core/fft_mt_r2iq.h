@@ -1,17 +1,51 @@
 #pragma once
 
 #include "r2iq.h"
-#include "fftw3.h"
+#include "fft_backend.h"
 #include "config.h"
+#include "pffft/pf_mixer.h"
+#include "halfband.h"
+#include "resampler.h"
 #include <algorithm>
+#include <math.h>
 #include <string.h>
+#include <vector>
 
 // use up to this many threads
-#define N_MAX_R2IQ_THREADS 1
-#define PRINT_INPUT_RANGE  0
+#define N_MAX_R2IQ_THREADS 8
+// and this many DDC channels, including the main one
+#define N_MAX_R2IQ_CHANNELS 32
+// range of the size of the first fft at ADC real rate
+#define FFTN_R_ADC_MIN 2048
+#define FFTN_R_ADC_MAX 65536
 
-static const int halfFft = FFTN_R_ADC / 2;    // half the size of the first fft at ADC 64Msps real rate (2048)
-static const int fftPerBuf = transferSize / sizeof(short) / (3 * halfFft / 2) + 1; // number of ffts per buffer with 256|768 overlap
+// conversion of 'count' samples into a ring block of 'blockLen' samples in
+// an r2iqFormat, from sample 'pos' on
+typedef void (*r2iqStore)(void* block, int blockLen, int pos, const fftComplex* source, int count, float scale);
+
+// inner loop kernels of the worker threads, one table per instruction set,
+// see fft_mt_r2iq_kernels.hpp
+struct r2iqKernels {
+    const char *name;
+    void (*convert_float[2])(const int16_t *input, float* output, int size);   // [rand]
+    void (*convert_stats[2])(const int16_t *input, float* output, int size, adcStats* stats);   // [rand], counting them
+    void (*shift_freq[2])(fftComplex* dest, const fftComplex* source1, const fftComplex* source2, int start, int end);   // [conj]
+    void (*copy[2])(fftComplex* dest, const fftComplex* source, int count);   // [flip]
+    rationalResampler::firKernel fir;
+    halfbandCascade::stageKernel halfband;
+    void (*power)(const fftComplex* in, int count, float* sum);   // adds the Hann windowed |X|^2, see setSpectrum()
+    r2iqStore store[NFORMAT][2];     // [format][planar]
+};
+
+extern const r2iqKernels r2iqKernels_def, r2iqKernels_avx, r2iqKernels_avx2, r2iqKernels_avx512, r2iqKernels_neon;
+extern const r2iqKernels r2iqKernels_ref;   // scalar reference
+
+// the kernel tables this cpu can run, best first, then the scalar
+// reference; null terminated
+const r2iqKernels* const* r2iqKernelList();
+// kernels by name, nullptr for the default: $SDDC_R2IQ_KERNELS or else the
+// best one. nullptr if this cpu cannot run them or there are none
+const r2iqKernels* r2iqKernelFind(const char* name);
 
 class fft_mt_r2iq : public r2iqControlClass
 {
@@ -19,110 +53,278 @@ public:
     fft_mt_r2iq();
     virtual ~fft_mt_r2iq();
 
+    // tunes exactly: whole bins in the frequency domain, the rest with a
+    // phase continuous mixer in the worker threads, nothing is left for
+    // the caller to apply (returns 0)
     float setFreqOffset(float offset);
 
+    // additional DDC channels, reusing the forward FFT of the main channel 0
+    // (which is set up with Init, setDecimate, setSideband and setFreqOffset).
+    // Decimations from NDECIDX on continue the highest fft one that has its
+    // full filter length with half-band stages. interp / decim <= 1
+    // resamples the output, see rationalResampler. The format is that of
+    // the output ring, see setOutputFormat().
+    // The output ring needs the block size of the main output buffer.
+    // Channels can be added and removed while running; removeChannel()
+    // returns when the channel's output ring is no longer used, so keep
+    // reading it until then.
+    int addChannel(ringbuffer<float>* obuffers, int decimate, bool lsb, int interp = 1, int decim = 1,
+        const r2iqOutputFormat& format = r2iqOutputFormat());  // returns channel or -1
+    void removeChannel(int channel);
+    float setChannelFreqOffset(int channel, float offset);
+    // changes the decimation, sideband and resampling of a channel without
+    // stopping: the one dispatching input blocks takes them as one with a
+    // block that starts an output ring block, the ring keeps its block size
+    // and format. A channel which is or was resampled keeps filling its
+    // ring at commit. Channel 0 is the main one. Returns false for a
+    // channel which is not there or for settings addChannel() refuses
+    bool reconfigureChannel(int channel, int decimate, bool lsb, int interp = 1, int decim = 1);
+    bool reconfigure(int decimate, bool lsb, int interp, int decim) override { return reconfigureChannel(0, decimate, lsb, interp, decim); }
+
+    // number of worker threads, 0 = one per cpu of the THREAD_R2IQ
+    // placement, or else one less than the number of cores. Takes effect
+    // with the next TurnOn()
+    void setThreads(int count) { this->threadsConfig = count; }
+    int getThreads() const { return this->processor_count; }
+
+    // size of the first fft at ADC real rate, a power of 2 from
+    // FFTN_R_ADC_MIN to FFTN_R_ADC_MAX (default FFTN_R_ADC). Smaller sizes
+    // give shorter segments, larger ones allow the longer filters of the
+    // higher decimations (up to fft / 4 taps, see getFilterTaps()).
+    // Takes effect with the next Init() or TurnOn(), returns false if
+    // the size is not supported
+    bool setFftSize(int size);
+    int getFftSize() const { return 2 * this->halfFft; }
+
+    // filter length of a decimation, and the number of ffts per input block
+    // while it is the highest decimation of the channels
+    int getFilterTaps(int decimate) const { return this->filterTaps[decimate]; }
+    int getSegments(int decimate) const { return (int)this->segments[decimate].size(); }
+
+    // fft implementation, see fftBackendList(), nullptr for the default.
+    // Takes effect with the next Init() or TurnOn(), returns false if
+    // there is no such backend
+    bool setFftBackend(const char* name);
+    const char* getFftBackend() const { return this->backendConfig->name(); }
+
+    // instruction set of the worker threads by kernel table name, see
+    // r2iqKernelFind(); the worker loop is built once per table. Takes
+    // effect with the next TurnOn(), returns false if there is no such one
+    bool setKernels(const char* name);
+    const char* getKernels() const { return this->kernelsConfig->name; }
+
+    // wideband power spectrum of the ADC input, from the forward ffts the
+    // workers run anyway: 'bins' (a power of 2 up to half the fft size)
+    // from 0 to ADC rate / 2, each the sum of the Hann windowed power of
+    // its fft bins, averaged over the segments of 'blocksPerFrame' input
+    // blocks. It is relative to a full scale ADC sine, which adds up to
+    // 1.0 over the bins it falls into. A frame of 'bins' floats goes into 'ring' if
+    // it has room, frames the reader does not keep up with are dropped,
+    // the DDC does not wait for it. nullptr turns it off.
+    // Takes effect with the next TurnOn(), which turns it off if the fft
+    // has less than 2 * bins; returns false for bins it cannot deliver
+    bool setSpectrum(ringbuffer<float>* ring, int bins, int blocksPerFrame) override;
+
     void Init(float gain, ringbuffer<int16_t>* buffers, ringbuffer<float>* obuffers);
     void TurnOn();
     void TurnOff(void);
     bool IsOn(void);
 
-protected:
+private:
+    ringbuffer<int16_t>* inputbuffer;    // pointer to input buffers
+    ringbuffer<float>* outputbuffer;    // pointer to ouput buffers
 
-    template<bool rand> void convert_float(const int16_t *input, float* output, int size)
-    {
-        for(int m = 0; m < size; m++)
-        {
-            int16_t val;
-            if (rand && (input[m] & 1))
-            {
-                val = input[m] ^ (-2);
-            }
-            else
-            {
-                val = input[m];
-            }
-            output[m] = float(val);
-        }
-    }
+    // workers take consecutive input blocks in dispatch order and commit
+    // them in the same order: input block n is released once block n+1,
+    // which needs its tail as overlap, is done.
+    int threadsConfig;
+    int inIndex;        // input ring slot of the next block to be dispatched
+    int inStops;        // ring stop count at TurnOn()
+    uint64_t dispatchSeq;   // sequence number of the next block to be dispatched
+    uint64_t commitSeq;     // sequence number of the next block to be committed
+    std::mutex mutexCommit;
+    std::condition_variable commitCV;
 
-    void shift_freq(fftwf_complex* dest, const fftwf_complex* source1, const fftwf_complex* source2, int start, int end)
-    {
-        for (int m = start; m < end; m++)
-        {
-            // besides circular shift, do complex multiplication with the lowpass filter's spectrum
-            dest[m][0] = source1[m][0] * source2[m][0] - source1[m][1] * source2[m][1];
-            dest[m][1] = source1[m][1] * source2[m][0] + source1[m][0] * source2[m][1];
-        }
-    }
+    struct r2iqChannel {
+        ringbuffer<float>* outputbuffer;
+        int decimate;
+        bool lsb;
+        float offset;       // requested tuning, relative to fs/2
+        int tunebin;        // whole bin part of the tuning
+        float fine;         // remaining part in cycles per output sample
+        double phase;       // fine tuning phase at the next dispatched block, in cycles
+        bool active;
 
-    template<bool flip> void copy(fftwf_complex* dest, const fftwf_complex* source, int count)
-    {
-        if (flip)
-        {
-            for (int i = 0; i < count; i++)
-            {
-                dest[i][0] = source[i][0];
-                dest[i][1] = -source[i][1];
-            }
-        }
-        else
-        {
-            for (int i = 0; i < count; i++)
-            {
-                dest[i][0] = source[i][0];
-                dest[i][1] = source[i][1];
-            }
-        }
-    }
+        uint64_t firstSeq;  // first block dispatched to this channel
+        int outIndex;       // output ring slot of the next block to be dispatched
+        int outStops;       // ring stop count when started
+        float *outBlock;    // output ring block currently being filled
+        int outFill;        // samples in it, when it is filled at commit
+        int interp;         // resampling after the decimation
+        int decim;
+        r2iqOutputFormat format;
+        float scale;        // of the format, with its default applied
+        int blockLen;       // samples per output ring block
+        bool commitFill;    // the ring blocks are filled at commit, with resampling
+        halfbandCascade cascade;    // after the fft decimation, run in block order
+        rationalResampler resampler;    // after the cascade, run in block order
 
-private:
-    ringbuffer<int16_t>* inputbuffer;    // pointer to input buffers
-    ringbuffer<float>* outputbuffer;    // pointer to ouput buffers
-    int bufIdx;         // index to next buffer to be processed
-    r2iqThreadArg* lastThread;
+        // reconfigureChannel() settings for the dispatch to switch to
+        struct {
+            bool set;
+            int decimate;
+            bool lsb;
+            int interp;
+            int decim;
+        } next;
+    };
+    // the decimation of the fft stage, the rest is up to the half-band stages
+    int fftDecimate(int decimate) const { return decimate < NDECIDX ? decimate : this->cascadeFrom; }
+    r2iqChannel channels[N_MAX_R2IQ_CHANNELS];
+
+    void startChannel(r2iqChannel& ch);
+    void switchChannel(r2iqChannel& ch, uint64_t seq);     // to ch.next, at dispatch
+    void writeOutput(r2iqChannel& ch, const fftComplex* data, int count, r2iqStore store);   // at commit
+    void tuneChannel(r2iqChannel& ch, float offset);
+    std::mutex mutexTune;   // tuning of the channels, taken inside mutexR2iqControl
 
     float GainScale;
+    int fftSizeConfig;
+    int halfFft;            // half the size of the first fft at ADC real rate
     int mfftdim [NDECIDX]; // FFT N dimensions: mfftdim[k] = halfFft / 2^k
-    int mtunebin;
+    int filterTaps[NDECIDX];    // filter length at the rate of halfFft bins
+    int cascadeFrom;            // fft decimation the half-band stages start from
+    int overlap;                // output sample 0 of a block is its ADC sample -overlap
+
+    // overlap-save segments of an input block, in ADC samples: each one
+    // transforms the 2 * halfFft samples from 'start' (negative is in the
+    // previous block) and keeps 'length' samples from 'keep' at 'pos' of
+    // the block's output. At the output rate all of them are >> (decimate + 1)
+    // The samples from statsBegin to statsEnd of the segment go into the
+    // ADC statistics: the segments of a block count the 'transferSamples'
+    // from its output sample 0 on, each sample once.
+    struct r2iqSegment {
+        int start;
+        int keep;
+        int length;
+        int pos;
+        bool direct;    // the whole inverse fft fits into the block's output
+        int statsBegin;
+        int statsEnd;
+    };
+    // one layout per decimation, which discards what its filter needs and
+    // the filters of the lower decimations; a block uses the layout of the
+    // highest decimation of its channels
+    std::vector<r2iqSegment> segments[NDECIDX];
+
+    // the whole bin shift mixes from the first sample of each segment on;
+    // this phase of a segment starting at ADC sample 'start' of a block
+    // turns it into one oscillator over the stream, in radian. The blocks
+    // start at whole turns of it (transferSamples is a multiple of the fft
+    // size), a tunebin in steps of 4 does not at each segment
+    float binPhase(int tunebin, int start, bool lsb) const
+    {
+        const int64_t turns = ((int64_t)tunebin * start) & (2 * halfFft - 1);
+        const float phase = (float)(2.0 * 3.14159265358979323846 * (double)turns / (2.0 * halfFft));
+        return lsb ? phase : -phase;
+    }
+
+    ringbuffer<float>* spectrumConfig;
+    int spectrumBinsConfig;
+    int spectrumBlocksConfig;
+    ringbuffer<float>* spectrumRing;    // of the running spectrum, nullptr when off
+    int spectrumBins;
+    int spectrumBlocks;
+    int spectrumCount;                  // blocks in spectrumSum
+    int spectrumSegments;               // ffts in spectrumSum
+    std::vector<float> spectrumSum;     // per fft bin, up to halfFft
+    void addSpectrum(const float* power, int segments);    // at commit
+
+    void setupFft();    // plans, filters and segments of fftSizeConfig and backendConfig
+    void freeFft();
 
     void *r2iqThreadf(r2iqThreadArg *th);   // thread function
 
+    // the worker loop of each kernel table
+    typedef void* (fft_mt_r2iq::*r2iqWorker)(r2iqThreadArg *th);
+    static r2iqWorker workerOf(const r2iqKernels* kernels);
+    const r2iqKernels* kernelsConfig;
+    r2iqWorker worker;      // of kernelsConfig at TurnOn()
+
+    void * r2iqThreadf_ref(r2iqThreadArg *th);
     void * r2iqThreadf_def(r2iqThreadArg *th);
     void * r2iqThreadf_avx(r2iqThreadArg *th);
     void * r2iqThreadf_avx2(r2iqThreadArg *th);
     void * r2iqThreadf_avx512(r2iqThreadArg *th);
     void * r2iqThreadf_neon(r2iqThreadArg *th);
 
-    fftwf_complex **filterHw;       // Hw complex to each decimation ratio
+    fftComplex **filterHw;       // Hw complex to each decimation ratio
 
-	fftwf_plan plan_t2f_r2c;          // fftw plan buffers Freq to Time complex to complex per decimation ratio
-	fftwf_plan *plan_f2t_c2c;          // fftw plan buffers Time to Freq real to complex per buffer
-	fftwf_plan plans_f2t_c2c[NDECIDX];
+    const fftBackend* backendConfig;
+    const fftBackend* backend;      // of the plans
+	fftR2c* plan_t2f_r2c;          // fft plan buffers Freq to Time complex to complex per decimation ratio
+	fftC2c* plans_f2t_c2c[NDECIDX];
+	fftC2c* plans_f2t_c2c_lsb[NDECIDX];   // forward, for the conjugated spectrum of the lower sideband
 
     uint32_t processor_count;
     r2iqThreadArg* threadArgs[N_MAX_R2IQ_THREADS];
-    std::mutex mutexR2iqControl;                   // r2iq control lock
+    std::mutex mutexR2iqControl;                   // r2iq control and dispatch lock
     std::thread r2iq_thread[N_MAX_R2IQ_THREADS]; // thread pointers
 };
 
-// assure, that ADC is not oversteered?
-struct r2iqThreadArg {
+// one channel's part of the block a worker is processing
+struct r2iqChannelJob {
+	ringbuffer<float>* outputbuffer;
+	fftComplex* pout;            // float output inside the ring block or in th->staging, else nullptr
+	void* block;                    // output ring block, nullptr when resampled
+	int blockPos;                   // of this block's output in it
+	int blockLen;
+	r2iqStore store;                // into the ring block in the channel's format
+	float scale;
+	int channel;
+	int staging;                    // pout in th->staging for the stages at commit, or -1
+	int decimate;                   // of the fft stage
+	fftC2c* plan;                   // inverse fft of the sideband
+	int tunebin;
+	float fine;                     // fine tuning in cycles per output sample
+	float phase;                    // and its phase at the start of the block, in radian
+	bool mix;                       // fine tuning or whole bin phase to apply with the mixer
+	float binPhase;                 // whole bin phase the mixer applies, in radian
+	shift_limited_unroll_C_sse_data_t mixer;
+	bool lsb;
+	bool complete;                  // output ring block is complete with this block
+	bool restart;                   // the channel switched with this block: the stages at commit start over
+	int stages;                     // with these half-band stages
+	int interp;                     // and this resampling
+	int decim;
+};
 
-	r2iqThreadArg()
+// turns the phase of the mixer by 'phase' radian from where it is
+static inline void rotate_mixer(shift_limited_unroll_C_sse_data_t* mixer, float phase)
+{
+	const float c = cosf(phase);
+	const float s = sinf(phase);
+	for (int k = 0; k < PF_SHIFT_LIMITED_SIMD_SZ; k++)
 	{
-#if PRINT_INPUT_RANGE
-		MinMaxBlockCount = 0;
-		MinValue = 0;
-		MaxValue = 0;
-#endif
+		const float i = mixer->phase_state_i[k];
+		const float q = mixer->phase_state_q[k];
+		mixer->phase_state_i[k] = i * c - q * s;
+		mixer->phase_state_q[k] = i * s + q * c;
 	}
+}
 
-	float *ADCinTime;                // point to each threads input buffers [nftt][n]
-	fftwf_complex *ADCinFreq;         // buffers in frequency
-	fftwf_complex *inFreqTmp;         // tmp decimation output buffers (after tune shift)
-#if PRINT_INPUT_RANGE
-	int MinMaxBlockCount;
-	int16_t MinValue;
-	int16_t MaxValue;
-#endif
+struct r2iqThreadArg {
+	float *ADCinTime;                // point to each threads input buffer of one fft segment
+	fftComplex *ADCinFreq;         // buffers in frequency
+	fftComplex *inFreqTmp;         // tmp decimation output buffers (after tune shift)
+	fftComplex *outTimeTmp;        // inverse fft output of segments not transformed into the output block
+	fftComplex *staging;           // fft stage output of the jobs with half-band stages or resampling
+	int stagingSize;
+	int stagingUsed;
+	r2iqChannelJob jobs[N_MAX_R2IQ_CHANNELS];
+	int jobCount;
+	int layout;                       // segment layout of the block, the highest decimation of the jobs
+	adcStats adc;                     // of the block, published at commit
+	float *power;                     // spectrum of the block, halfFft bins
+	int powerSegments;                // ffts in it
 };
@@ -1,169 +1,263 @@
 
 {
-	const int decimate = this->mdecimation;
-	const int mfft = this->mfftdim[decimate];	// = halfFft / 2^mdecimation
-	const fftwf_complex* filter = filterHw[decimate];
-	const bool lsb = this->getSideband();
-	const auto filter2 = &filter[halfFft - mfft / 2];
-
-	plan_f2t_c2c = &plans_f2t_c2c[decimate];
-	fftwf_complex* pout = nullptr;
-	int decimate_count = 0;
-
 	while (r2iqOn) {
 		const int16_t *dataADC;  // pointer to input data
-		const int16_t *endloop;    // pointer to end data to be copied to beginning
-
-		const int _mtunebin = this->mtunebin;  // Update LO tune is possible during run
+		const int16_t *endloop;    // pointer to the end of the previous block, the overlap
+		uint64_t seq;
 
 		{
+			// dispatch the next input block and its place in the outputs
 			std::unique_lock<std::mutex> lk(mutexR2iqControl);
-			dataADC = inputbuffer->getReadPtr();
-
 			if (!r2iqOn)
 				return 0;
 
-			this->bufIdx = (this->bufIdx + 1) % QUEUE_SIZE;
+			seq = this->dispatchSeq++;
+
+			dataADC = inputbuffer->getReadPtrAt(this->inIndex, this->inStops);
+			endloop = inputbuffer->peekPtr(this->inIndex - 1) + transferSamples;
+			this->inIndex = inputbuffer->nextIndex(this->inIndex);
+
+			th->jobCount = 0;
+			th->layout = 0;
+			th->stagingUsed = 0;
+			for (int c = 0; c < N_MAX_R2IQ_CHANNELS; c++)
+			{
+				auto &ch = this->channels[c];
+				if (!ch.active)
+					continue;
+
+				// a reconfiguration starts with an output ring block
+				const bool restart = ch.next.set &&
+					(ch.commitFill || ((seq - ch.firstSeq) & ((1u << ch.decimate) - 1)) == 0);
+				if (restart)
+				{
+					std::unique_lock<std::mutex> lkTune(mutexTune);
+					switchChannel(ch, seq);
+				}
+
+				const int outPerBlock = transferSamples >> (ch.decimate + 1);
+				const int fftDecimation = fftDecimate(ch.decimate);
+				const int fftPerBlock = transferSamples >> (fftDecimation + 1);
+				const int decimate_mask = (1 << ch.decimate) - 1;
+				const int decimate_count = (int)((seq - ch.firstSeq) & decimate_mask);
+				const bool atCommit = ch.commitFill;   // fills its ring blocks at commit
+				if (decimate_count == 0 && !atCommit)
+				{
+					ch.outBlock = ch.outputbuffer->getWritePtrAt(ch.outIndex, ch.outStops);
+					ch.outIndex = ch.outputbuffer->nextIndex(ch.outIndex);
+				}
+
+				auto &job = th->jobs[th->jobCount++];
+				job.outputbuffer = ch.outputbuffer;
+				job.block = atCommit ? nullptr : ch.outBlock;
+				job.blockPos = outPerBlock * decimate_count;
+				job.blockLen = ch.blockLen;
+				job.store = stores[ch.format.format][ch.format.planar];
+				job.scale = ch.scale;
+				job.channel = c;
+				job.staging = -1;
+				// the inverse ffts write floats straight into the ring
+				// block, the other formats are converted from th->outTimeTmp
+				job.pout = nullptr;
+				if (ch.format.format == FORMAT_CF32 && !ch.format.planar && ch.scale == 1.0f)
+					job.pout = (fftComplex*)ch.outBlock + job.blockPos;
+				if (ch.decimate != fftDecimation || atCommit)
+				{
+					job.staging = th->stagingUsed;
+					th->stagingUsed += fftPerBlock;
+				}
+				job.decimate = fftDecimation;
+				// the lower sideband mirrors by conjugating the output:
+				// conj(IFFT(X)) = FFT(conj(X)), so it conjugates the spectrum
+				// and transforms forward, at the same cost as the upper sideband
+				job.plan = ch.lsb ? plans_f2t_c2c_lsb[fftDecimation] : plans_f2t_c2c[fftDecimation];
+				{
+					// only the snapshot of the tuning holds mutexTune, not the
+					// wait for a ring block above: a retune never waits for
+					// the consumer of the outputs
+					std::unique_lock<std::mutex> lkTune(mutexTune);
+					job.tunebin = ch.tunebin;  // Update LO tune is possible during run
+					job.fine = ch.fine;
+					job.phase = (float)(2.0 * 3.14159265358979323846 * ch.phase);
+					ch.phase = fmod(ch.phase + (double)ch.fine * fftPerBlock, 1.0);
+				}
+				job.lsb = ch.lsb;
+				job.complete = (decimate_count == decimate_mask) && !atCommit;
+				job.restart = restart;
+				job.stages = ch.decimate - fftDecimation;
+				job.interp = ch.interp;
+				job.decim = ch.decim;
+				th->layout = std::max(th->layout, fftDecimation);
+			}
 
-			endloop = inputbuffer->peekReadPtr(-1) + transferSamples - halfFft;
+			if (!r2iqOn)
+				return 0;
 		}
 
-		auto inloop = th->ADCinTime;
+		const auto convert = this->getRand() ? convert_segment<true> : convert_segment<false>;
+		th->adc = adcStats();
 
-		// @todo: move the following int16_t conversion to (32-bit) float
-		// directly inside the following loop (for "k < fftPerBuf")
-		//   just before the forward fft "fftwf_execute_dft_r2c" is called
-		// idea: this should improve cache/memory locality
-#if PRINT_INPUT_RANGE
-		std::pair<int16_t, int16_t> blockMinMax = std::make_pair<int16_t, int16_t>(0, 0);
-#endif
-		if (!this->getRand())        // plain samples no ADC rand set
+		if (th->stagingUsed > th->stagingSize)
 		{
-			convert_float<false>(endloop, inloop, halfFft);
-#if PRINT_INPUT_RANGE
-			auto minmax = std::minmax_element(dataADC, dataADC + transferSamples);
-			blockMinMax.first = *minmax.first;
-			blockMinMax.second = *minmax.second;
-#endif
-			convert_float<false>(dataADC, inloop + halfFft, transferSamples);
+			fftFree(th->staging);
+			th->staging = (fftComplex*)fftAlloc(sizeof(fftComplex) * th->stagingUsed);
+			th->stagingSize = th->stagingUsed;
 		}
-		else
+		const auto &layout = this->segments[th->layout];
+		for (int j = 0; j < th->jobCount; j++)
 		{
-			convert_float<true>(endloop, inloop, halfFft);
-			convert_float<true>(dataADC, inloop + halfFft, transferSamples);
+			auto &job = th->jobs[j];
+			if (job.staging >= 0)
+				job.pout = th->staging + job.staging;
+			// the mixer also turns the segments to the phase of the whole bins
+			job.mix = (job.fine != 0.0f);
+			for (size_t k = 0; k < layout.size() && !job.mix; k++)
+				job.mix = (this->binPhase(job.tunebin, layout[k].start, job.lsb) != 0.0f);
+			job.binPhase = 0.0f;
+			if (job.mix)
+				job.mixer = shift_limited_unroll_C_sse_init(job.fine, job.phase);
 		}
-
-#if PRINT_INPUT_RANGE
-		th->MinValue = std::min(blockMinMax.first, th->MinValue);
-		th->MaxValue = std::max(blockMinMax.second, th->MaxValue);
-		++th->MinMaxBlockCount;
-		if (th->MinMaxBlockCount * processor_count / 3 >= DEFAULT_TRANSFERS_PER_SEC )
+		const bool spectrum = (this->spectrumRing != nullptr);
+		if (spectrum)
 		{
-			float minBits = (th->MinValue < 0) ? (log10f((float)(-th->MinValue)) / log10f(2.0f)) : -1.0f;
-			float maxBits = (th->MaxValue > 0) ? (log10f((float)(th->MaxValue)) / log10f(2.0f)) : -1.0f;
-			printf("r2iq: min = %d (%.1f bits) %.2f%%, max = %d (%.1f bits) %.2f%%\n",
-				(int)th->MinValue, minBits, th->MinValue *-100.0f / 32768.0f,
-				(int)th->MaxValue, maxBits, th->MaxValue * 100.0f / 32768.0f);
-			th->MinValue = 0;
-			th->MaxValue = 0;
-			th->MinMaxBlockCount = 0;
+			memset(th->power, 0, sizeof(float) * halfFft);
+			th->powerSegments = (int)layout.size();
 		}
-#endif
-		dataADC = nullptr;
-		inputbuffer->ReadDone();
-		// decimate in frequency plus tuning
-
-		if (decimate_count == 0)
-			pout = (fftwf_complex*)outputbuffer->getWritePtr();
-
-		decimate_count = (decimate_count + 1) & ((1 << decimate) - 1);
 
-		// Calculate the parameters for the first half
-		const auto count = std::min(mfft/2, halfFft - _mtunebin);
-		const auto source = &th->ADCinFreq[_mtunebin];
+		// the inverse fft of a segment 'out' into the channel's output,
+		// from where it is not affected by the filter, with fine tuning
+		auto storeSegment = [this, th](r2iqChannelJob &job, const r2iqSegment &seg, fftComplex *out)
+		{
+			const int keep = seg.keep >> (job.decimate + 1);
+			const int length = seg.length >> (job.decimate + 1);
+			const int pos = seg.pos >> (job.decimate + 1);
+			if (job.mix)
+			{
+				const float phase = this->binPhase(job.tunebin, seg.start, job.lsb);
+				if (phase != job.binPhase)
+					rotate_mixer(&job.mixer, phase - job.binPhase);
+				job.binPhase = phase;
+			}
+			// the other formats than float are converted with the last copy
+			if (job.pout == nullptr)
+			{
+				if (job.mix)
+					shift_limited_unroll_C_sse_inp_c((complexf*)&out[keep], length, &job.mixer);
+				job.store(job.block, job.blockLen, job.blockPos + pos, &out[keep], length, job.scale);
+				return;
+			}
+			copy<false>(job.pout + pos, &out[keep], length);
+			if (job.mix)
+				shift_limited_unroll_C_sse_inp_c((complexf*)(job.pout + pos), length, &job.mixer);
+		};
 
-		// Calculate the parameters for the second half
-		const auto start = std::max(0, mfft / 2 - _mtunebin);
-		const auto source2 = &th->ADCinFreq[_mtunebin - mfft / 2];
-		const auto dest = &th->inFreqTmp[mfft / 2];
-		for (int k = 0; k < fftPerBuf; k++)
+		for (size_t k = 0; k < layout.size(); k++)
 		{
+			const auto &seg = layout[k];
 			// core of fast convolution including filter and decimation
 			//   main part is 'overlap-scrap' (IMHO better name for 'overlap-save'), see
 			//   https://en.wikipedia.org/wiki/Overlap%E2%80%93save_method
+
+			// int16_t to float conversion of just this segment, so it stays in
+			// cache, counting the ADC statistics on the way. The stream starts
+			// with sample 0 of the first block, there is nothing before
+			const int statsBegin = (seq == 0) ? std::max(seg.statsBegin, std::min(-seg.start, seg.statsEnd)) : seg.statsBegin;
+			convert(endloop, dataADC, th->ADCinTime, seg.start, 2 * halfFft, statsBegin, seg.statsEnd, th->adc);
+
+			// FFT first stage: time to frequency, real to complex
+			// 'full' transformation size: 2 * halfFft
+			// this is shared by all channels
+			plan_t2f_r2c->execute(th->ADCinTime, th->ADCinFreq);
+			// result now in th->ADCinFreq[]
+			if (spectrum)
+				power(th->ADCinFreq, halfFft, th->power);
+
+			for (int j = 0; j < th->jobCount; j++)
 			{
-				// FFT first stage: time to frequency, real to complex
-				// 'full' transformation size: 2 * halfFft
-				fftwf_execute_dft_r2c(plan_t2f_r2c, th->ADCinTime + (3 * halfFft / 2) * k, th->ADCinFreq);
-				// result now in th->ADCinFreq[]
+				auto &job = th->jobs[j];
+				const int mfft = this->mfftdim[job.decimate];	// = halfFft / 2^decimate
+				const auto shift = job.lsb ? shift_filter<true> : shift_filter<false>;
+				const auto plan = job.plan;
 
-				// circular shift (mixing in full bins) and low/bandpass filtering (complex multiplication)
-				{
-					// circular shift tune fs/2 first half array into th->inFreqTmp[]
-					shift_freq(th->inFreqTmp, source, filter, 0, count);
-					if (mfft / 2 != count)
-						memset(th->inFreqTmp[count], 0, sizeof(float) * 2 * (mfft / 2 - count));
-
-					// circular shift tune fs/2 second half array
-					shift_freq(dest, source2, filter2, start, mfft/2);
-					if (start != 0)
-						memset(th->inFreqTmp[mfft / 2], 0, sizeof(float) * 2 * start);
-				}
+				// decimate in frequency plus tuning: circular shift (mixing in
+				// full bins) and low/bandpass filtering (complex multiplication)
+				shift(th->inFreqTmp, th->ADCinFreq, filterHw[job.decimate], halfFft, mfft, job.tunebin);
 				// result now in th->inFreqTmp[]
 
 				// 'shorter' inverse FFT transform (decimation); frequency (back) to COMPLEX time domain
-				// transform size: mfft = mfftdim[k] = halfFft / 2^k with k = mdecimation
-				fftwf_execute_dft(*plan_f2t_c2c, th->inFreqTmp, th->inFreqTmp);     //  c2c decimation
-				// result now in th->inFreqTmp[]
-			}
-
-			// postprocessing
-			// @todo: is it possible to ..
-			//  1)
-			//    let inverse FFT produce/save it's result directly
-			//    in "this->obuffers[modx] + offset" (pout)
-			//    ( obuffers[] would need to have additional space ..;
-			//      need to move 'scrap' of 'ovelap-scrap'? )
-			//    at least FFTW would allow so,
-			//      see http://www.fftw.org/fftw3_doc/New_002darray-Execute-Functions.html
-			//    attention: multithreading!
-			//  2)
-			//    could mirroring (lower sideband) get calculated together
-			//    with fine mixer - modifying the mixer frequency? (fs - fc)/fs
-			//    (this would reduce one memory pass)
-			if (lsb) // lower sideband
-			{
-				// mirror just by negating the imaginary Q of complex I/Q
-				if (k == 0)
+				// transform size: mfft = mfftdim[k] = halfFft / 2^k with k = decimate
+				// overlap-scrap keeps the part not affected by the filter, see setupFft()
+				// The segments transform straight into the output block, their
+				// scrap is overwritten by the next segment of this thread.
+				// The last ones would write into the part of another thread,
+				// and go through th->outTimeTmp.
+				fftComplex* pout = (job.pout != nullptr) ? job.pout + (seg.pos >> (job.decimate + 1)) : nullptr;
+				if (pout == nullptr || !seg.direct || !plan->accepts(pout))
 				{
-					copy<true>(pout, &th->inFreqTmp[mfft / 4], mfft/2);
+					plan->execute(th->inFreqTmp, th->outTimeTmp);     //  c2c decimation
+					storeSegment(job, seg, th->outTimeTmp);
+					continue;
 				}
-				else
+
+				plan->execute(th->inFreqTmp, pout);     //  c2c decimation
+				// fine tuning, while the segment is in cache; it continues
+				// with the next segment, which follows in the output
+				if (job.mix)
 				{
-					copy<true>(pout + mfft / 2 + (3 * mfft / 4) * (k - 1), &th->inFreqTmp[0], (3 * mfft / 4));
+					const float phase = this->binPhase(job.tunebin, seg.start, job.lsb);
+					if (phase != job.binPhase)
+						rotate_mixer(&job.mixer, phase - job.binPhase);
+					job.binPhase = phase;
+					shift_limited_unroll_C_sse_inp_c((complexf*)pout, seg.length >> (job.decimate + 1), &job.mixer);
 				}
+				// result now in the channel's output block
 			}
-			else // upper sideband
+		}
+
+		{
+			// commit in order: release the previous input block, which was
+			// our overlap, and hand over the output blocks which are complete
+			std::unique_lock<std::mutex> lk(mutexCommit);
+			commitCV.wait(lk, [this, seq] { return this->commitSeq == seq || !r2iqOn; });
+			if (!r2iqOn)
+				return 0;
+
+			if (seq > 0)
+				inputbuffer->ReadDone();
+			addAdcStats(th->adc);
+			if (spectrum)
+				addSpectrum(th->power, th->powerSegments);
+			for (int j = 0; j < th->jobCount; j++)
 			{
-				if (k == 0)
+				auto &job = th->jobs[j];
+				// the half-band stages and the resampler keep their history
+				// from block to block
+				auto &ch = this->channels[job.channel];
+				if (job.restart)
 				{
-					copy<false>(pout, &th->inFreqTmp[mfft / 4], mfft/2);
+					ch.cascade.init(job.stages, transferSamples >> (job.decimate + 1));
+					ch.resampler.init(job.interp, job.decim);
 				}
-				else
+				if (job.staging >= 0)
 				{
-					copy<false>(pout + mfft / 2 + (3 * mfft / 4) * (k - 1), &th->inFreqTmp[0], (3 * mfft / 4));
+					const int count = transferSamples >> (job.decimate + 1);
+					int n = ch.cascade.process(job.pout, count, job.pout, halfband);
+					if (job.block != nullptr)
+					{
+						job.store(job.block, job.blockLen, job.blockPos, job.pout, n, job.scale);
+					}
+					else
+					{
+						n = ch.resampler.process(job.pout, n, job.pout, fir);
+						writeOutput(ch, job.pout, n, job.store);
+					}
 				}
+				if (job.complete)
+					job.outputbuffer->WriteDone();
 			}
-			// result now in this->obuffers[]
-		}
 
-		if (decimate_count == 0) {
-			outputbuffer->WriteDone();
-			pout = nullptr;
-		}
-		else
-		{
-			pout += mfft / 2 + (3 * mfft / 4) * (fftPerBuf - 1);
+			this->commitSeq = seq + 1;
+			commitCV.notify_all();
 		}
 	} // while(run)
 //    DbgPrintf((char *) "r2iqThreadf idx %d pthread_exit %u\n",(int)th->t, pthread_self());
@@ -0,0 +1,705 @@
+// inner loop kernels of the r2iq worker threads
+//
+// Included by each fft_mt_r2iq_<isa>.cpp, which are compiled with their own
+// instruction set flags. The kernels have internal linkage, so every
+// translation unit keeps its own version and exports it as a kernel table.
+// The SIMD versions use the same order of operations as the scalar
+// reference, results differ at most where the compiler fuses multiply-adds,
+// and in the sums of fir(), which add per vector lane.
+
+#include "fft_mt_r2iq.h"
+#include <type_traits>
+
+#if !defined(NO_SIMD_OPTIM)
+#if defined(__AVX512F__)
+	#define R2IQ_KERNELS_AVX512
+	#define R2IQ_KERNELS_NAME "avx512"
+#elif defined(__AVX2__)
+	#define R2IQ_KERNELS_AVX2
+	#define R2IQ_KERNELS_NAME "avx2"
+#elif defined(__AVX__)
+	#define R2IQ_KERNELS_AVX
+	#define R2IQ_KERNELS_NAME "avx"
+#elif defined(__SSE2__) || defined(_M_X64)
+	#define R2IQ_KERNELS_SSE2
+	#define R2IQ_KERNELS_NAME "sse2"
+#elif defined(__ARM_NEON)
+	#define R2IQ_KERNELS_NEON
+	#define R2IQ_KERNELS_NAME "neon"
+#endif
+#endif
+
+#ifndef R2IQ_KERNELS_NAME
+	#define R2IQ_KERNELS_NAME "scalar"
+#endif
+
+#if defined(R2IQ_KERNELS_NEON)
+	#include <arm_neon.h>
+#elif defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2)
+	#include <immintrin.h>
+#endif
+#if defined(R2IQ_KERNELS_AVX512) && defined(__GNUC__) && !defined(__clang__)
+	// gcc 12 warns on the _mm512_undefined_*() inside its own intrinsics
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace {
+
+// scalar reference versions
+
+template<bool rand> void convert_float_ref(const int16_t *input, float* output, int size)
+{
+	for(int m = 0; m < size; m++)
+	{
+		int16_t val;
+		if (rand && (input[m] & 1))
+		{
+			val = input[m] ^ (-2);
+		}
+		else
+		{
+			val = input[m];
+		}
+		output[m] = float(val);
+	}
+}
+
+// the ADC statistics of the converted samples, see adcStats
+template<bool rand> void convert_stats_ref(const int16_t *input, float* output, int size, adcStats* stats)
+{
+	convert_float_ref<rand>(input, output, size);
+	for (int m = 0; m < size; m++)
+	{
+		const int val = (int)output[m];
+		const int mag = (val < 0) ? -val - 1 : val;
+		int n = 0;
+		while (n < ADC_LEVELS - 1 && mag < (1 << (14 - n)))
+			n++;
+		stats->levels[n]++;
+		if (mag == 32767)
+			stats->clipped++;
+		stats->min = std::min(stats->min, (int16_t)val);
+		stats->max = std::max(stats->max, (int16_t)val);
+	}
+	stats->samples += size;
+}
+
+template<bool conj> void shift_freq_ref(fftComplex* dest, const fftComplex* source1, const fftComplex* source2, int start, int end)
+{
+	for (int m = start; m < end; m++)
+	{
+		// besides circular shift, do complex multiplication with the lowpass filter's spectrum
+		dest[m][0] = source1[m][0] * source2[m][0] - source1[m][1] * source2[m][1];
+		if (conj)
+			dest[m][1] = -(source1[m][1] * source2[m][0] + source1[m][0] * source2[m][1]);
+		else
+			dest[m][1] = source1[m][1] * source2[m][0] + source1[m][0] * source2[m][1];
+	}
+}
+
+template<bool flip> void copy_ref(fftComplex* dest, const fftComplex* source, int count)
+{
+	if (flip)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			dest[i][0] = source[i][0];
+			dest[i][1] = -source[i][1];
+		}
+	}
+	else
+	{
+		for (int i = 0; i < count; i++)
+		{
+			dest[i][0] = source[i][0];
+			dest[i][1] = source[i][1];
+		}
+	}
+}
+
+void fir_ref(const fftComplex* input, const float* coef, int taps, fftComplex* output)
+{
+	float re = 0.0f, im = 0.0f;
+	for (int k = 0; k < taps; k++)
+	{
+		re += input[k][0] * coef[2 * k];
+		im += input[k][1] * coef[2 * k + 1];
+	}
+	output[0][0] = re;
+	output[0][1] = im;
+}
+
+// a half-band stage, see halfbandCascade::stageKernel
+inline void halfband_ref(const fftComplex* even, const fftComplex* center, const float* coef, int taps, fftComplex* output, int count)
+{
+	for (int m = 0; m < count; m++)
+	{
+		fir_ref(even + m, coef, taps, output + m);
+		output[m][0] += 0.5f * center[m][0];
+		output[m][1] += 0.5f * center[m][1];
+	}
+}
+
+// the Hann window is a convolution in frequency: 0.5 X[k] - 0.25 (X[k-1] + X[k+1]),
+// its power added to sum[k], for the bins [begin, end) with begin >= 1
+void power_bins_ref(const fftComplex* in, int begin, int end, float* sum)
+{
+	for (int k = begin; k < end; k++)
+	{
+		const float re = 0.5f * in[k][0] - 0.25f * (in[k - 1][0] + in[k + 1][0]);
+		const float im = 0.5f * in[k][1] - 0.25f * (in[k - 1][1] + in[k + 1][1]);
+		sum[k] += re * re + im * im;
+	}
+}
+
+// adds the windowed power of the bins [0, count) of a real to complex fft,
+// which has count + 1 bins; X[-1] is conj(X[1])
+void power_ref(const fftComplex* in, int count, float* sum)
+{
+	const float re = 0.5f * in[0][0] - 0.5f * in[1][0];
+	const float im = 0.5f * in[0][1];
+	sum[0] += re * re + im * im;
+	power_bins_ref(in, 1, count, sum);
+}
+
+// IEEE half float, rounded to nearest even
+inline uint16_t float_to_half(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, sizeof(f));
+	const uint16_t sign = (uint16_t)((f >> 16) & 0x8000);
+	const uint32_t absf = f & 0x7fffffff;
+	if (absf >= 0x7f800000)     // inf, nan
+		return sign | 0x7c00 | (absf > 0x7f800000 ? 0x200 : 0);
+	if (absf >= 0x477ff000)     // rounds beyond 65504
+		return sign | 0x7c00;
+	if (absf < 0x38800000)      // subnormal: the bits left of 2^-24
+	{
+		const int shift = 126 - (int)(absf >> 23);
+		if (shift > 24)
+			return sign;
+		const uint32_t mant = (absf & 0x7fffff) | 0x800000;
+		uint32_t h = mant >> shift;
+		const uint32_t rest = mant & ((1u << shift) - 1);
+		const uint32_t half = 1u << (shift - 1);
+		if (rest > half || (rest == half && (h & 1)))
+			h++;
+		return sign | (uint16_t)h;
+	}
+	// rebias the exponent, round the 13 dropped bits
+	uint32_t h = (absf - 0x38000000) >> 13;
+	const uint32_t rest = absf & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+		h++;
+	return sign | (uint16_t)h;
+}
+
+inline void to_sample(float value, float& out) { out = value; }
+inline void to_sample(float value, int16_t& out) { out = (int16_t)nearbyintf(std::min(std::max(value, -32768.0f), 32767.0f)); }
+inline void to_sample(float value, int8_t& out) { out = (int8_t)nearbyintf(std::min(std::max(value, -128.0f), 127.0f)); }
+inline void to_sample(float value, uint16_t& out) { out = float_to_half(value); }
+
+template<typename T, bool planar> void store_ref(void* block, int blockLen, int pos, const fftComplex* source, int count, float scale)
+{
+	T* dest = (T*)block;
+	for (int i = 0; i < count; i++)
+	{
+		if (planar)
+		{
+			to_sample(source[i][0] * scale, dest[pos + i]);
+			to_sample(source[i][1] * scale, dest[blockLen + pos + i]);
+		}
+		else
+		{
+			to_sample(source[i][0] * scale, dest[2 * (pos + i)]);
+			to_sample(source[i][1] * scale, dest[2 * (pos + i) + 1]);
+		}
+	}
+}
+
+// ADC statistics per vector lane, one add() per vector of samples, then
+// flush() into adcStats. The 16 bit counters hold up to 65535 vectors
+#if defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2)
+typedef __m256i adcVector;
+inline adcVector adc_set(int16_t v) { return _mm256_set1_epi16(v); }
+inline adcVector adc_min(adcVector a, adcVector b) { return _mm256_min_epi16(a, b); }
+inline adcVector adc_max(adcVector a, adcVector b) { return _mm256_max_epi16(a, b); }
+inline adcVector adc_magnitude(adcVector x) { return _mm256_xor_si256(x, _mm256_srai_epi16(x, 15)); }
+inline adcVector adc_count(adcVector count, adcVector a, adcVector b) { return _mm256_sub_epi16(count, _mm256_cmpgt_epi16(a, b)); }
+inline void adc_store(int16_t* lanes, adcVector v) { _mm256_storeu_si256((__m256i*)lanes, v); }
+#elif defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2)
+typedef __m128i adcVector;
+inline adcVector adc_set(int16_t v) { return _mm_set1_epi16(v); }
+inline adcVector adc_min(adcVector a, adcVector b) { return _mm_min_epi16(a, b); }
+inline adcVector adc_max(adcVector a, adcVector b) { return _mm_max_epi16(a, b); }
+inline adcVector adc_magnitude(adcVector x) { return _mm_xor_si128(x, _mm_srai_epi16(x, 15)); }
+inline adcVector adc_count(adcVector count, adcVector a, adcVector b) { return _mm_sub_epi16(count, _mm_cmpgt_epi16(a, b)); }
+inline void adc_store(int16_t* lanes, adcVector v) { _mm_storeu_si128((__m128i*)lanes, v); }
+#elif defined(R2IQ_KERNELS_NEON)
+typedef int16x8_t adcVector;
+inline adcVector adc_set(int16_t v) { return vdupq_n_s16(v); }
+inline adcVector adc_min(adcVector a, adcVector b) { return vminq_s16(a, b); }
+inline adcVector adc_max(adcVector a, adcVector b) { return vmaxq_s16(a, b); }
+inline adcVector adc_magnitude(adcVector x) { return veorq_s16(x, vshrq_n_s16(x, 15)); }
+inline adcVector adc_count(adcVector count, adcVector a, adcVector b) { return vsubq_s16(count, vreinterpretq_s16_u16(vcgtq_s16(a, b))); }
+inline void adc_store(int16_t* lanes, adcVector v) { vst1q_s16(lanes, v); }
+#endif
+
+#if defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2) || defined(R2IQ_KERNELS_NEON)
+class adcCounter {
+public:
+	enum { lanes = sizeof(adcVector) / sizeof(int16_t) };
+
+	adcCounter() : vmin(adc_set(INT16_MAX)), vmax(adc_set(INT16_MIN)), clipped(adc_set(0))
+	{
+		for (int n = 0; n < ADC_LEVELS - 1; n++)
+			above[n] = adc_set(0);
+	}
+
+	void add(adcVector x)
+	{
+		vmin = adc_min(vmin, x);
+		vmax = adc_max(vmax, x);
+		const adcVector mag = adc_magnitude(x);
+		clipped = adc_count(clipped, mag, adc_set(32766));
+		// spelled out, the counters stay in registers
+		above[0] = adc_count(above[0], mag, adc_set(16383));
+		above[1] = adc_count(above[1], mag, adc_set(8191));
+		above[2] = adc_count(above[2], mag, adc_set(4095));
+		above[3] = adc_count(above[3], mag, adc_set(2047));
+		above[4] = adc_count(above[4], mag, adc_set(1023));
+		above[5] = adc_count(above[5], mag, adc_set(511));
+		above[6] = adc_count(above[6], mag, adc_set(255));
+	}
+
+	void flush(adcStats& stats, int samples) const
+	{
+		int16_t lane[lanes];
+		stats.samples += samples;
+		adc_store(lane, vmin);
+		for (int l = 0; l < lanes; l++)
+			stats.min = std::min(stats.min, lane[l]);
+		adc_store(lane, vmax);
+		for (int l = 0; l < lanes; l++)
+			stats.max = std::max(stats.max, lane[l]);
+		stats.clipped += sum(clipped);
+		uint64_t higher = 0;
+		for (int n = 0; n < ADC_LEVELS - 1; n++)
+		{
+			const uint64_t count = sum(above[n]);
+			stats.levels[n] += count - higher;
+			higher = count;
+		}
+		stats.levels[ADC_LEVELS - 1] += samples - higher;
+	}
+
+private:
+	static uint64_t sum(adcVector v)
+	{
+		int16_t lane[lanes];
+		adc_store(lane, v);
+		uint64_t total = 0;
+		for (int l = 0; l < lanes; l++)
+			total += (uint16_t)lane[l];
+		return total;
+	}
+
+	adcVector vmin;
+	adcVector vmax;
+	adcVector clipped;
+	adcVector above[ADC_LEVELS - 1];    // magnitude at least 2^(14 - n)
+};
+#endif
+
+// int16_t to float, with de-randomization: samples with the LSB set get
+// all other bits inverted. With 'count' the de-randomized samples are
+// added to the ADC statistics on the way
+template<bool rand, bool count> void convert(const int16_t *input, float* output, int size, adcStats* stats)
+{
+	int m = 0;
+#if defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2)
+	adcCounter counter;
+	for (; m + 16 <= size; m += 16)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(input + m));
+		if (rand)
+			x = _mm256_xor_si256(x, _mm256_slli_epi16(_mm256_srai_epi16(_mm256_slli_epi16(x, 15), 15), 1));
+		if (count)
+			counter.add(x);
+#if defined(R2IQ_KERNELS_AVX512)
+		_mm512_storeu_ps(output + m, _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(x)));
+#else
+		_mm256_storeu_ps(output + m, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x))));
+		_mm256_storeu_ps(output + m + 8, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1))));
+#endif
+	}
+#elif defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2)
+	adcCounter counter;
+	for (; m + 8 <= size; m += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(input + m));
+		if (rand)
+			x = _mm_xor_si128(x, _mm_slli_epi16(_mm_srai_epi16(_mm_slli_epi16(x, 15), 15), 1));
+		if (count)
+			counter.add(x);
+		// sign extend to 32 bit
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps(output + m, _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(output + m + 4, _mm_cvtepi32_ps(hi));
+	}
+#elif defined(R2IQ_KERNELS_NEON)
+	adcCounter counter;
+	for (; m + 8 <= size; m += 8)
+	{
+		int16x8_t x = vld1q_s16(input + m);
+		if (rand)
+			x = veorq_s16(x, vshlq_n_s16(vshrq_n_s16(vshlq_n_s16(x, 15), 15), 1));
+		if (count)
+			counter.add(x);
+		vst1q_f32(output + m, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+		vst1q_f32(output + m + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+	}
+#endif
+	if (count)
+	{
+#if defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2) || defined(R2IQ_KERNELS_NEON)
+		counter.flush(*stats, m);
+#endif
+		convert_stats_ref<rand>(input + m, output + m, size - m, stats);
+	}
+	else
+	{
+		convert_float_ref<rand>(input + m, output + m, size - m);
+	}
+}
+
+template<bool rand> void convert_float(const int16_t *input, float* output, int size)
+{
+	convert<rand, false>(input, output, size, nullptr);
+}
+
+template<bool rand> void convert_stats(const int16_t *input, float* output, int size, adcStats* stats)
+{
+	convert<rand, true>(input, output, size, stats);
+}
+
+// complex multiplication dest = source1 * source2 over [start, end),
+// conjugated for the mirrored lower sideband
+template<bool conj> void shift_freq(fftComplex* dest, const fftComplex* source1, const fftComplex* source2, int start, int end)
+{
+	int m = start;
+#if defined(R2IQ_KERNELS_AVX512)
+	const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+	for (; m + 8 <= end; m += 8)
+	{
+		__m512 a = _mm512_loadu_ps(source1[m]);
+		__m512 b = _mm512_loadu_ps(source2[m]);
+		__m512 t1 = _mm512_mul_ps(a, _mm512_moveldup_ps(b));                            // ar*br, ai*br
+		__m512 t2 = _mm512_mul_ps(_mm512_permute_ps(a, 0xB1), _mm512_movehdup_ps(b));   // ai*bi, ar*bi
+		__m512 r = _mm512_mask_sub_ps(_mm512_add_ps(t1, t2), 0x5555, t1, t2);
+		if (conj)
+			r = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(r), sign));
+		_mm512_storeu_ps(dest[m], r);
+	}
+#elif defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX)
+	const __m256 sign = _mm256_set_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f);
+	for (; m + 4 <= end; m += 4)
+	{
+		__m256 a = _mm256_loadu_ps(source1[m]);
+		__m256 b = _mm256_loadu_ps(source2[m]);
+		__m256 t1 = _mm256_mul_ps(a, _mm256_moveldup_ps(b));                            // ar*br, ai*br
+		__m256 t2 = _mm256_mul_ps(_mm256_permute_ps(a, 0xB1), _mm256_movehdup_ps(b));   // ai*bi, ar*bi
+		__m256 r = _mm256_addsub_ps(t1, t2);
+		if (conj)
+			r = _mm256_xor_ps(r, sign);
+		_mm256_storeu_ps(dest[m], r);
+	}
+#elif defined(R2IQ_KERNELS_SSE2)
+	// negate ai*bi, and for conj the result's imaginary part
+	const __m128 sign = _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f);
+	const __m128 signConj = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+	for (; m + 2 <= end; m += 2)
+	{
+		__m128 a = _mm_loadu_ps(source1[m]);
+		__m128 b = _mm_loadu_ps(source2[m]);
+		__m128 t1 = _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0)));      // ar*br, ai*br
+		__m128 t2 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+			_mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1)));                             // ai*bi, ar*bi
+		__m128 r = _mm_add_ps(t1, _mm_xor_ps(t2, sign));
+		if (conj)
+			r = _mm_xor_ps(r, signConj);
+		_mm_storeu_ps(dest[m], r);
+	}
+#elif defined(R2IQ_KERNELS_NEON)
+	for (; m + 4 <= end; m += 4)
+	{
+		float32x4x2_t a = vld2q_f32(source1[m]);
+		float32x4x2_t b = vld2q_f32(source2[m]);
+		float32x4x2_t r;
+		r.val[0] = vsubq_f32(vmulq_f32(a.val[0], b.val[0]), vmulq_f32(a.val[1], b.val[1]));
+		r.val[1] = vaddq_f32(vmulq_f32(a.val[1], b.val[0]), vmulq_f32(a.val[0], b.val[1]));
+		if (conj)
+			r.val[1] = vnegq_f32(r.val[1]);
+		vst2q_f32(dest[m], r);
+	}
+#endif
+	shift_freq_ref<conj>(dest, source1, source2, m, end);
+}
+
+// the whole bin shift and the filter of a channel for one segment: the
+// r2c bins from tunebin on into the first half of the mfft bins of 'dest',
+// the ones below it into the second half, zero beyond the r2c output
+template<bool conj> void shift_filter(fftComplex* dest, const fftComplex* in, const fftComplex* filter, int halfFft, int mfft, int tunebin)
+{
+	const int count = std::min(mfft / 2, halfFft - tunebin);
+	const int start = std::max(0, mfft / 2 - tunebin);
+	shift_freq<conj>(dest, in + tunebin, filter, 0, count);
+	if (mfft / 2 != count)
+		memset(dest[count], 0, sizeof(fftComplex) * (mfft / 2 - count));
+	shift_freq<conj>(dest + mfft / 2, in + tunebin - mfft / 2, &filter[halfFft - mfft / 2], start, mfft / 2);
+	if (start != 0)
+		memset(dest[mfft / 2], 0, sizeof(fftComplex) * start);
+}
+
+// copy, for the lower sideband conjugated
+template<bool flip> void copy(fftComplex* dest, const fftComplex* source, int count)
+{
+	if (!flip)
+	{
+		memcpy(dest, source, sizeof(fftComplex) * count);
+		return;
+	}
+
+	int i = 0;
+#if defined(R2IQ_KERNELS_AVX512)
+	const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm512_storeu_si512(dest[i], _mm512_xor_si512(_mm512_loadu_si512(source[i]), sign));
+	}
+#elif defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX)
+	const __m256 sign = _mm256_set_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm256_storeu_ps(dest[i], _mm256_xor_ps(_mm256_loadu_ps(source[i]), sign));
+	}
+#elif defined(R2IQ_KERNELS_SSE2)
+	const __m128 sign = _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+	for (; i + 2 <= count; i += 2)
+	{
+		_mm_storeu_ps(dest[i], _mm_xor_ps(_mm_loadu_ps(source[i]), sign));
+	}
+#elif defined(R2IQ_KERNELS_NEON)
+	const float32x4_t sign = { 1.0f, -1.0f, 1.0f, -1.0f };
+	for (; i + 2 <= count; i += 2)
+	{
+		vst1q_f32(dest[i], vmulq_f32(vld1q_f32(source[i]), sign));
+	}
+#endif
+	copy_ref<true>(dest + i, source + i, count - i);
+}
+
+// dot product of the samples with a filter phase of the resampler, whose
+// taps come in I/Q pairs. The vectors sum per lane, then across them
+inline void fir(const fftComplex* input, const float* coef, int taps, fftComplex* output)
+{
+	int k = 0;
+	float re = 0.0f, im = 0.0f;
+#if defined(R2IQ_KERNELS_AVX512)
+	__m512 acc = _mm512_setzero_ps();
+	for (; k + 8 <= taps; k += 8)
+	{
+		acc = _mm512_add_ps(acc, _mm512_mul_ps(_mm512_loadu_ps(input[k]), _mm512_loadu_ps(coef + 2 * k)));
+	}
+	alignas(64) float lanes[16];
+	_mm512_store_ps(lanes, acc);
+	for (int l = 0; l < 16; l += 2)
+	{
+		re += lanes[l];
+		im += lanes[l + 1];
+	}
+#elif defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX)
+	__m256 acc = _mm256_setzero_ps();
+	for (; k + 4 <= taps; k += 4)
+	{
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(input[k]), _mm256_loadu_ps(coef + 2 * k)));
+	}
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	re = _mm_cvtss_f32(sum);
+	im = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(R2IQ_KERNELS_SSE2)
+	__m128 acc = _mm_setzero_ps();
+	for (; k + 2 <= taps; k += 2)
+	{
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(input[k]), _mm_loadu_ps(coef + 2 * k)));
+	}
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	re = _mm_cvtss_f32(acc);
+	im = _mm_cvtss_f32(_mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(R2IQ_KERNELS_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (; k + 2 <= taps; k += 2)
+	{
+		acc = vmlaq_f32(acc, vld1q_f32(input[k]), vld1q_f32(coef + 2 * k));
+	}
+	float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+	re = vget_lane_f32(sum, 0);
+	im = vget_lane_f32(sum, 1);
+#endif
+	fir_ref(input + k, coef + 2 * k, taps - k, output);
+	output[0][0] += re;
+	output[0][1] += im;
+}
+
+// a half-band stage: one fir() per output over the even input samples
+inline void halfband(const fftComplex* even, const fftComplex* center, const float* coef, int taps, fftComplex* output, int count)
+{
+	for (int m = 0; m < count; m++)
+	{
+		fir(even + m, coef, taps, output + m);
+		output[m][0] += 0.5f * center[m][0];
+		output[m][1] += 0.5f * center[m][1];
+	}
+}
+
+// windowed power of the forward fft, for the spectrum. Each vector of bins
+// loads its neighbours unaligned, then the squares of I and Q are paired up
+inline void power(const fftComplex* in, int count, float* sum)
+{
+	power_ref(in, 1, sum);
+	int k = 1;
+#if defined(R2IQ_KERNELS_AVX512) || defined(R2IQ_KERNELS_AVX2)
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	for (; k + 8 <= count; k += 8)
+	{
+		__m256 w0 = _mm256_sub_ps(_mm256_mul_ps(half, _mm256_loadu_ps(in[k])),
+			_mm256_mul_ps(quarter, _mm256_add_ps(_mm256_loadu_ps(in[k - 1]), _mm256_loadu_ps(in[k + 1]))));
+		__m256 w1 = _mm256_sub_ps(_mm256_mul_ps(half, _mm256_loadu_ps(in[k + 4])),
+			_mm256_mul_ps(quarter, _mm256_add_ps(_mm256_loadu_ps(in[k + 3]), _mm256_loadu_ps(in[k + 5]))));
+		// the pairs come out as k 0 1 4 5 2 3 6 7
+		__m256 p = _mm256_hadd_ps(_mm256_mul_ps(w0, w0), _mm256_mul_ps(w1, w1));
+		p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(sum + k, _mm256_add_ps(_mm256_loadu_ps(sum + k), p));
+	}
+#elif defined(R2IQ_KERNELS_AVX) || defined(R2IQ_KERNELS_SSE2)
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	for (; k + 4 <= count; k += 4)
+	{
+		__m128 w0 = _mm_sub_ps(_mm_mul_ps(half, _mm_loadu_ps(in[k])),
+			_mm_mul_ps(quarter, _mm_add_ps(_mm_loadu_ps(in[k - 1]), _mm_loadu_ps(in[k + 1]))));
+		__m128 w1 = _mm_sub_ps(_mm_mul_ps(half, _mm_loadu_ps(in[k + 2])),
+			_mm_mul_ps(quarter, _mm_add_ps(_mm_loadu_ps(in[k + 1]), _mm_loadu_ps(in[k + 3]))));
+		w0 = _mm_mul_ps(w0, w0);
+		w1 = _mm_mul_ps(w1, w1);
+		__m128 p = _mm_add_ps(_mm_shuffle_ps(w0, w1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(w0, w1, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm_storeu_ps(sum + k, _mm_add_ps(_mm_loadu_ps(sum + k), p));
+	}
+#elif defined(R2IQ_KERNELS_NEON)
+	for (; k + 4 <= count; k += 4)
+	{
+		const float32x4x2_t a = vld2q_f32(in[k - 1]);
+		const float32x4x2_t b = vld2q_f32(in[k]);
+		const float32x4x2_t c = vld2q_f32(in[k + 1]);
+		float32x4_t re = vsubq_f32(vmulq_n_f32(b.val[0], 0.5f), vmulq_n_f32(vaddq_f32(a.val[0], c.val[0]), 0.25f));
+		float32x4_t im = vsubq_f32(vmulq_n_f32(b.val[1], 0.5f), vmulq_n_f32(vaddq_f32(a.val[1], c.val[1]), 0.25f));
+		vst1q_f32(sum + k, vaddq_f32(vld1q_f32(sum + k), vaddq_f32(vmulq_f32(re, re), vmulq_f32(im, im))));
+	}
+#endif
+	power_bins_ref(in, k, count, sum);
+}
+
+// the last copy into the ring block, in its sample format. The floats are
+// copied as they are with scale 1, int16_t has its own vectors, the other
+// formats are loops for the compiler to vectorize
+template<typename T, bool planar> void store(void* block, int blockLen, int pos, const fftComplex* source, int count, float scale)
+{
+	int i = 0;
+	if (std::is_same<T, float>::value && !planar && scale == 1.0f)
+	{
+		memcpy((fftComplex*)block + pos, source, sizeof(fftComplex) * count);
+		return;
+	}
+	if (std::is_same<T, int16_t>::value && !planar)
+	{
+		int16_t* dest = (int16_t*)block + 2 * pos;
+		(void)dest;     // no vectors without SIMD
+#if defined(R2IQ_KERNELS_AVX512)
+		const __m512 s = _mm512_set1_ps(scale);
+		const __m512 lo = _mm512_set1_ps(-32768.0f);
+		const __m512 hi = _mm512_set1_ps(32767.0f);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(source[i]), s), lo), hi);
+			_mm256_storeu_si256((__m256i*)(dest + 2 * i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(v)));
+		}
+#elif defined(R2IQ_KERNELS_AVX2) || defined(R2IQ_KERNELS_AVX)
+		const __m256 s = _mm256_set1_ps(scale);
+		const __m256 lo = _mm256_set1_ps(-32768.0f);
+		const __m256 hi = _mm256_set1_ps(32767.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source[i]), s), lo), hi);
+			__m256i n = _mm256_cvtps_epi32(v);
+			_mm_storeu_si128((__m128i*)(dest + 2 * i), _mm_packs_epi32(_mm256_castsi256_si128(n), _mm256_extractf128_si256(n, 1)));
+		}
+#elif defined(R2IQ_KERNELS_SSE2)
+		const __m128 s = _mm_set1_ps(scale);
+		const __m128 lo = _mm_set1_ps(-32768.0f);
+		const __m128 hi = _mm_set1_ps(32767.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 v0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source[i]), s), lo), hi);
+			__m128 v1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source[i + 2]), s), lo), hi);
+			_mm_storeu_si128((__m128i*)(dest + 2 * i), _mm_packs_epi32(_mm_cvtps_epi32(v0), _mm_cvtps_epi32(v1)));
+		}
+#elif defined(R2IQ_KERNELS_NEON) && defined(__aarch64__)
+		const float32x4_t lo = vdupq_n_f32(-32768.0f);
+		const float32x4_t hi = vdupq_n_f32(32767.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4_t v0 = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(source[i]), scale), lo), hi);
+			float32x4_t v1 = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(source[i + 2]), scale), lo), hi);
+			vst1q_s16(dest + 2 * i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(v0)), vqmovn_s32(vcvtnq_s32_f32(v1))));
+		}
+#endif
+	}
+	store_ref<T, planar>(block, blockLen, pos + i, source + i, count - i, scale);
+}
+
+#define R2IQ_STORES(name) { { name<float, false>, name<float, true> }, { name<int16_t, false>, name<int16_t, true> }, \
+	{ name<int8_t, false>, name<int8_t, true> }, { name<uint16_t, false>, name<uint16_t, true> } }
+
+// the stores of this translation unit by [format][planar]
+const r2iqStore stores[NFORMAT][2] = R2IQ_STORES(store);
+
+// convert the samples [begin, end) of an fft segment from 'offset' in the
+// input block, a negative offset starts in the previous block ending at 'tail'
+template<bool rand, bool count> void convert_range(const int16_t *tail, const int16_t *input, float* output, int offset, int begin, int end, adcStats* stats)
+{
+	const int split = std::min(std::max(-offset, begin), end);    // the first one in this block
+	if (split > begin)
+		convert<rand, count>(tail + offset + begin, output + begin, split - begin, stats);
+	if (end > split)
+		convert<rand, count>(input + offset + split, output + split, end - split, stats);
+}
+
+// convert the 'size' samples of an fft segment, the ones from statsBegin
+// to statsEnd go into the ADC statistics
+template<bool rand> void convert_segment(const int16_t *tail, const int16_t *input, float* output, int offset, int size,
+	int statsBegin, int statsEnd, adcStats& stats)
+{
+	convert_range<rand, false>(tail, input, output, offset, 0, statsBegin, nullptr);
+	convert_range<rand, true>(tail, input, output, offset, statsBegin, statsEnd, &stats);
+	convert_range<rand, false>(tail, input, output, offset, statsEnd, size, nullptr);
+}
+
+} // namespace
+
+// the kernel table of this translation unit
+#define R2IQ_KERNEL_TABLE { R2IQ_KERNELS_NAME, \
+	{ convert_float<false>, convert_float<true> }, { convert_stats<false>, convert_stats<true> }, \
+	{ shift_freq<false>, shift_freq<true> }, { copy<false>, copy<true> }, fir, halfband, power, R2IQ_STORES(store) }
@@ -1,7 +1,10 @@
 #include "fft_mt_r2iq.h"
 #include "config.h"
-#include "fftw3.h"
+#include "fft_backend.h"
 #include "RadioHandler.h"
+#include "fft_mt_r2iq_kernels.hpp"
+
+const r2iqKernels r2iqKernels_neon = R2IQ_KERNEL_TABLE;
 
 void * fft_mt_r2iq::r2iqThreadf_neon(r2iqThreadArg *th)
 {
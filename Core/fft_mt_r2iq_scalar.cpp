@@ -0,0 +1,21 @@
+// the scalar reference build of the worker loop: its kernels are the plain
+// loops, without the intrinsics of the other instruction sets, for tests
+// and for pinning the kernels with fft_mt_r2iq::setKernels("scalar")
+#ifndef NO_SIMD_OPTIM
+#define NO_SIMD_OPTIM
+#endif
+
+#include "fft_mt_r2iq.h"
+#include "config.h"
+#include "fft_backend.h"
+#include "RadioHandler.h"
+#include "fft_mt_r2iq_kernels.hpp"
+
+const r2iqKernels r2iqKernels_ref = { "scalar",
+	{ convert_float_ref<false>, convert_float_ref<true> }, { convert_stats_ref<false>, convert_stats_ref<true> },
+	{ shift_freq_ref<false>, shift_freq_ref<true> }, { copy_ref<false>, copy_ref<true> }, fir_ref, halfband_ref, power_ref, R2IQ_STORES(store_ref) };
+
+void * fft_mt_r2iq::r2iqThreadf_ref(r2iqThreadArg *th)
+{
+    #include "fft_mt_r2iq_impl.hpp"
+}
@@ -0,0 +1,168 @@
+#include "license.txt"
+
+#ifndef NO_FFTW
+
+#include "fftw_wisdom.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <filesystem>
+#include <system_error>
+
+#if defined(_WIN32)
+	#include <intrin.h>
+	#define cpuid(info, x)    __cpuidex(info, x, 0)
+	#define HAVE_CPUID
+#elif defined(__x86_64__)
+	#include <cpuid.h>
+	#define cpuid(info, x)  __cpuid_count(x, 0, info[0], info[1], info[2], info[3])
+	#define HAVE_CPUID
+#endif
+
+static std::string wisdomDir;
+static unsigned wisdomPlanner = FFTW_MEASURE;
+
+void fftwWisdom::setDir(const char *dir)
+{
+	wisdomDir = (dir != nullptr) ? dir : "";
+}
+
+std::string fftwWisdom::getDir()
+{
+	if (!wisdomDir.empty())
+		return wisdomDir;
+
+	const char *env = getenv("SDDC_WISDOM_DIR");
+	if (env != nullptr && env[0] != 0)
+		return env;
+
+#if defined(_WIN32)
+	env = getenv("LOCALAPPDATA");
+	if (env != nullptr && env[0] != 0)
+		return std::string(env) + "\\sddc";
+#else
+	env = getenv("XDG_CACHE_HOME");
+	if (env != nullptr && env[0] != 0)
+		return std::string(env) + "/sddc";
+	env = getenv("HOME");
+	if (env != nullptr && env[0] != 0)
+		return std::string(env) + "/.cache/sddc";
+#endif
+	return ".";
+}
+
+void fftwWisdom::setPlanner(unsigned flags)
+{
+	wisdomPlanner = flags;
+}
+
+unsigned fftwWisdom::getPlanner()
+{
+	return wisdomPlanner;
+}
+
+// the cpu brand string, or what /proc/cpuinfo tells about it
+static std::string readCpuName()
+{
+	std::string name;
+#ifdef HAVE_CPUID
+	int info[4];
+	cpuid(info, 0x80000000);
+	if ((unsigned)info[0] >= 0x80000004)
+	{
+		char brand[49];
+		for (int i = 0; i < 3; i++)
+		{
+			cpuid(info, 0x80000002 + i);
+			memcpy(brand + 16 * i, info, sizeof(info));
+		}
+		brand[48] = 0;
+		name = brand;
+	}
+#elif defined(__linux__)
+	// arm: the first core's implementer and part, which identify the core
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+	if (fp != nullptr)
+	{
+		char line[256];
+		std::string model, implementer, part;
+		while (fgets(line, sizeof(line), fp) != nullptr)
+		{
+			const char *value = strchr(line, ':');
+			if (value == nullptr)
+				continue;
+			value++;
+			std::string v(value + strspn(value, " \t"));
+			v.erase(v.find_last_not_of(" \t\r\n") + 1);
+			if (model.empty() && strncmp(line, "model name", 10) == 0)
+				model = v;
+			else if (implementer.empty() && strncmp(line, "CPU implementer", 15) == 0)
+				implementer = v;
+			else if (part.empty() && strncmp(line, "CPU part", 8) == 0)
+				part = v;
+		}
+		fclose(fp);
+		if (!implementer.empty())
+			name = "arm " + implementer + " " + part;
+		else
+			name = model;
+	}
+#endif
+	if (name.empty())
+		name = "unknown";
+
+	// file name safe: letters, digits, '.' and single '-' for the rest
+	std::string safe;
+	for (char c : name)
+	{
+		if (isalnum((unsigned char)c) || c == '.')
+			safe += c;
+		else if (!safe.empty() && safe.back() != '-')
+			safe += '-';
+	}
+	while (!safe.empty() && safe.back() == '-')
+		safe.pop_back();
+	return safe;
+}
+
+const std::string& fftwWisdom::cpuName()
+{
+	static const std::string name = readCpuName();
+	return name;
+}
+
+std::string fftwWisdom::fileName(int fftSize)
+{
+	return (std::filesystem::path(getDir()) /
+		("fftwf-" + cpuName() + "-" + std::to_string(fftSize) + ".wisdom")).string();
+}
+
+bool fftwWisdom::load(int fftSize)
+{
+	std::string file = fileName(fftSize);
+	bool ok = fftwf_import_wisdom_from_filename(file.c_str()) != 0;
+	DbgPrintf("fft wisdom %s %s\n", file.c_str(), ok ? "loaded" : "not found");
+	return ok;
+}
+
+bool fftwWisdom::save(int fftSize)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(getDir(), ec);
+
+	std::string file = fileName(fftSize);
+	bool ok = fftwf_export_wisdom_to_filename(file.c_str()) != 0;
+	DbgPrintf("fft wisdom %s %s\n", file.c_str(), ok ? "saved" : "not saved");
+	return ok;
+}
+
+bool fftwWisdom::remove(int fftSize)
+{
+	std::error_code ec;
+	return std::filesystem::remove(fileName(fftSize), ec);
+}
+
+#endif
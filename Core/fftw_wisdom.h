@@ -0,0 +1,30 @@
+#pragma once
+
+#include "fftw3.h"
+#include <string>
+
+// FFTW wisdom cache: one file per cpu model and fft size in a cache
+// directory, so the plans are measured once per machine and not on each
+// start. The directory is $SDDC_WISDOM_DIR, or else the user's cache
+// directory (%LOCALAPPDATA%\sddc, $XDG_CACHE_HOME/sddc or ~/.cache/sddc).
+// Planning is not thread safe in FFTW, neither are these.
+class fftwWisdom {
+public:
+    static void setDir(const char *dir);   // nullptr for the default
+    static std::string getDir();
+
+    // planner rigor used when there is no wisdom, FFTW_MEASURE by default
+    static void setPlanner(unsigned flags);
+    static unsigned getPlanner();
+
+    // cpu model as used in the file names
+    static const std::string& cpuName();
+    static std::string fileName(int fftSize);
+
+    // import the cached wisdom of the size, false if there is none
+    static bool load(int fftSize);
+    // export the wisdom to the size's file, creating the directory; the
+    // fft backend forgets the other sizes' wisdom before it plans a size
+    static bool save(int fftSize);
+    static bool remove(int fftSize);
+};
@@ -0,0 +1,75 @@
+#include "license.txt"
+
+#include "halfband.h"
+#include "fir.h"
+
+#include <algorithm>
+#include <string.h>
+
+void halfbandCascade::init(int stages, int count, float Astop, float relPass)
+{
+	stage.resize(stages);
+	for (int s = 0; s < stages; s++)
+	{
+		// relative to the input rate of the stage; the half-band filter
+		// is symmetric around a quarter of it
+		const float normFpass = relPass / 2.0f / (float)(1 << (stages - s));
+		const float normFstop = 0.5f - normFpass;
+		const int estimate = KaiserWindow(0, Astop, normFpass, normFstop, nullptr);
+		const int n = (estimate + 4) / 4;    // 4 * n - 1 taps, with the odd ones at the ends
+
+		std::vector<float> h(4 * n - 1);
+		KaiserWindow(4 * n - 1, Astop, normFpass, normFstop, h.data());
+		auto &st = stage[s];
+		st.taps = 2 * n;
+		st.coef.resize(2 * st.taps);
+		for (int k = 0; k < st.taps; k++)
+			st.coef[2 * k] = st.coef[2 * k + 1] = h[2 * k];
+
+		// the input of a stage is half of the previous one's
+		const int half = (count >> s) / 2;
+		st.even.resize(2 * (st.taps - 1 + half));
+		st.odd.resize(2 * (st.taps / 2 + half));
+	}
+	reset();
+}
+
+void halfbandCascade::reset()
+{
+	for (auto &st : stage)
+	{
+		std::fill(st.even.begin(), st.even.end(), 0.0f);
+		std::fill(st.odd.begin(), st.odd.end(), 0.0f);
+	}
+}
+
+int halfbandCascade::process(fftComplex* in, int count, fftComplex* out, stageKernel kernel)
+{
+	for (size_t s = 0; s < stage.size(); s++)
+	{
+		auto &st = stage[s];
+		const int evenHistory = st.taps - 1;
+		const int oddHistory = st.taps / 2;
+		const int half = count / 2;
+		fftComplex* dest = (s + 1 == stage.size()) ? out : in;
+
+		fftComplex* even = (fftComplex*)st.even.data();
+		fftComplex* odd = (fftComplex*)st.odd.data();
+		for (int i = 0; i < half; i++)
+		{
+			even[evenHistory + i][0] = in[2 * i][0];
+			even[evenHistory + i][1] = in[2 * i][1];
+			odd[oddHistory + i][0] = in[2 * i + 1][0];
+			odd[oddHistory + i][1] = in[2 * i + 1][1];
+		}
+
+		kernel(even, odd, st.coef.data(), st.taps, dest, half);
+
+		memmove(even, even + half, sizeof(fftComplex) * evenHistory);
+		memmove(odd, odd + half, sizeof(fftComplex) * oddHistory);
+		count = half;
+	}
+	if (stage.empty() && out != in)
+		memcpy(out, in, sizeof(fftComplex) * count);
+	return count;
+}
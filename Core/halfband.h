@@ -0,0 +1,46 @@
+#pragma once
+
+#include "fft_backend.h"
+#include <vector>
+
+// decimation of a complex stream by 2 per stage with half-band filters,
+// for the output rates below the fft decimation. All stages keep the
+// passband of the final output, relPass of its Nyquist, so the first ones
+// get by with few taps. Half-band filters are down at (2 - relPass) *
+// Nyquist: what lies in between folds into the band above relPass only.
+class halfbandCascade {
+public:
+    // 'count' outputs of a stage: output m is the dot product of the even
+    // input samples from even[m] on with 'taps' coefficients in I/Q pairs,
+    // like rationalResampler::firKernel, plus half the odd one center[m];
+    // see r2iqKernels
+    typedef void (*stageKernel)(const fftComplex* even, const fftComplex* center, const float* coef, int taps,
+        fftComplex* output, int count);
+
+    halfbandCascade() {}
+
+    // designs the filters and sizes the buffers for up to 'count' input
+    // samples per process(); with 0 stages process() copies
+    void init(int stages, int count, float Astop = 120.0f, float relPass = 0.85f);
+    void reset();   // clear the history, for a new stream
+
+    int getStages() const { return (int)stage.size(); }
+    int getTaps(int s) const { return 2 * stage[s].taps - 1; }
+
+    // count must be a multiple of 2^stages and at most the one of init(),
+    // returns count >> stages. The input is used as work buffer, out may
+    // be in
+    int process(fftComplex* in, int count, fftComplex* out, stageKernel kernel);
+
+private:
+    // the zero taps at the odd offsets from the center are left out: a
+    // stage filters the even input samples and adds the odd one between
+    // its two middle taps, its center, with the tap 0.5
+    struct hbStage {
+        int taps;                   // even ones, 2n for 4n - 1 taps
+        std::vector<float> coef;    // 'taps' I/Q pairs, symmetric
+        std::vector<float> even;    // I/Q of the even input history (taps - 1 samples), then the input
+        std::vector<float> odd;     // I/Q of the odd input history (taps / 2 samples), then the input
+    };
+    std::vector<hbStage> stage;
+};
@@ -2,17 +2,60 @@
 #define R2IQ_H
 #include "license.txt" 
 
-#define NDECIDX 7  //number of srate
+#define NDECIDX 7  //number of srate of the fft decimation
+#define NHALFBAND 4 // half-band decimations after the highest fft one, see halfbandCascade
+#define NDECIMATE (NDECIDX + NHALFBAND)  // number of srate
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <stdint.h>
 
 #include "dsp/ringbuffer.h"
 
 struct r2iqThreadArg;
 
+// output sample formats: a ring block holds as many complex samples as
+// with FORMAT_CF32, interleaved I/Q or, planar, all I then all Q samples
+enum r2iqFormat {
+    FORMAT_CF32,    // float
+    FORMAT_CS16,    // int16_t
+    FORMAT_CS8,     // int8_t
+    FORMAT_CF16,    // IEEE half float
+    NFORMAT
+};
+
+struct r2iqOutputFormat {
+    r2iqFormat format = FORMAT_CF32;
+    bool planar = false;
+    // applied to the float samples, 0 for the default: 1 for FORMAT_CF32,
+    // else a full scale ADC tone makes full scale of the format (1.0 for
+    // FORMAT_CF16). The integer formats saturate
+    float scale = 0.0f;
+
+    int sampleBytes() const
+    {
+        static const int bytes[NFORMAT] = { 8, 4, 2, 4 };
+        return bytes[format];
+    }
+};
+
+// ADC input statistics, counted while the samples are converted
+#define ADC_LEVELS 8
+struct adcStats {
+    uint64_t samples = 0;
+    uint64_t clipped = 0;       // at the lowest or the highest code
+    int16_t min = INT16_MAX;    // above max without samples
+    int16_t max = INT16_MIN;
+    // samples by their peak level in 6 dB steps from full scale: level n
+    // is below -6n dBFS (2^(15-n)) and not below -6(n+1) dBFS, the last
+    // one takes all below -42 dBFS
+    uint64_t levels[ADC_LEVELS] = {};
+
+    void add(const adcStats& other);
+};
+
 class r2iqControlClass {
 public:
     r2iqControlClass();
@@ -27,6 +70,14 @@ public:
     bool getSideband() const { return this->sideband; }
 
     void setDecimate(int dec) {this->mdecimation = dec; }
+    int getDecimate() const { return this->mdecimation; }
+    // after the decimation, interp / decim <= 1 (see rationalResampler)
+    void setResample(int interp, int decim) { this->resampleInterp = interp; this->resampleDecim = decim; }
+    int getResampleInterp() const { return this->resampleInterp; }
+    int getResampleDecim() const { return this->resampleDecim; }
+    // the ring blocks need sampleBytes() * EXT_BLOCKLEN bytes
+    void setOutputFormat(const r2iqOutputFormat& format) { this->outputFormat = format; }
+    const r2iqOutputFormat& getOutputFormat() const { return this->outputFormat; }
 
     virtual void Init(float gain, ringbuffer<int16_t>* input, ringbuffer<float>* obuffers) {}
     virtual void TurnOn() { this->r2iqOn = true; }
@@ -34,17 +85,41 @@ public:
     virtual bool IsOn(void) { return this->r2iqOn; }
     virtual void DataReady(void) {}
     virtual float setFreqOffset(float offset) { return 0; };
+    // the decimation, sideband and resampling of the main output, while it
+    // runs: they take effect together with a later input block. Returns
+    // false if they need TurnOff() and TurnOn() instead
+    virtual bool reconfigure(int decimate, bool lsb, int interp, int decim) { return false; }
+    // wideband power spectrum frames of 'bins' floats into 'ring', see
+    // fft_mt_r2iq; false if there is none
+    virtual bool setSpectrum(ringbuffer<float>* ring, int bins, int blocksPerFrame) { return false; }
+
+    // ADC statistics since the last reset, of the blocks the worker threads
+    // have converted; lock free, from any thread
+    adcStats getAdcStats(bool reset = false);
 
 protected:
     int mdecimation ;   // selected decimation ratio
       // 64 Msps:               0 => 32Msps, 1=> 16Msps, 2 = 8Msps, 3 = 4Msps, 4 = 2Msps
       // 128 Msps: 0 => 64Msps, 1 => 32Msps, 2=> 16Msps, 3 = 8Msps, 4 = 4Msps, 5 = 2Msps
+      // down to 2^(NDECIMATE-1): 64 Msps => 31.25 ksps
     bool r2iqOn;        // r2iq on flag
-    int mratio [NDECIDX];  // ratio
+    int mratio [NDECIMATE];  // ratio
+    int resampleInterp;
+    int resampleDecim;
+    r2iqOutputFormat outputFormat;
+
+    void addAdcStats(const adcStats& stats);   // in block order
 
 private:
     bool randADC;       // randomized ADC output
     bool sideband;
+
+    // adcStats, each field by itself
+    std::atomic<uint64_t> adcSamples;
+    std::atomic<uint64_t> adcClipped;
+    std::atomic<int> adcMin;
+    std::atomic<int> adcMax;
+    std::atomic<uint64_t> adcLevels[ADC_LEVELS];
 };
 
 #endif
@@ -0,0 +1,103 @@
+#include "license.txt"
+
+#include "resampler.h"
+#include "fir.h"
+
+#include <math.h>
+#include <string.h>
+
+void rationalResampler::init(int interp, int decim, float Astop, float relPass)
+{
+	this->interp = interp;
+	this->decim = decim;
+	taps = 0;
+	coef.clear();
+	if (interp != decim)
+	{
+		// a lowpass at interp times the input rate, for the output band
+		const float normFpass = relPass / 2.0f / (float)decim;
+		const float normFstop = (2.0f - relPass) / 2.0f / (float)decim;
+		const int estimate = KaiserWindow(0, Astop, normFpass, normFstop, nullptr);
+		taps = ((estimate + interp - 1) / interp + 3) & ~3;    // per phase, whole SIMD vectors
+
+		std::vector<float> h(taps * interp);
+		KaiserWindow(taps * interp, Astop, normFpass, normFstop, h.data());
+
+		// output sample n is sum_k h[p + k * interp] * x[q - k], with
+		// n * decim = q * interp + p
+		coef.resize(2 * taps * interp);
+		for (int p = 0; p < interp; p++)
+		{
+			float* c = &coef[2 * taps * p];
+			for (int m = 0; m < taps; m++)
+			{
+				c[2 * m] = c[2 * m + 1] = (float)interp * h[p + (taps - 1 - m) * interp];
+			}
+		}
+	}
+	reset();
+}
+
+void rationalResampler::reset()
+{
+	buf.assign(taps > 0 ? 2 * (taps - 1) : 0, 0.0f);
+	phase = 0;
+	next = 0;
+}
+
+int rationalResampler::process(const fftComplex* in, int count, fftComplex* out, firKernel fir)
+{
+	if (taps == 0)
+	{
+		if (out != in)
+			memcpy(out, in, sizeof(fftComplex) * count);
+		return count;
+	}
+
+	const int history = taps - 1;
+	buf.resize(2 * (history + count));
+	memcpy(&buf[2 * history], in, sizeof(fftComplex) * count);
+
+	const fftComplex* x = (const fftComplex*)buf.data();
+	int n = 0;
+	int i = next;
+	while (i + taps <= history + count)
+	{
+		fir(&x[i], &coef[2 * taps * phase], taps, &out[n++]);
+		phase += decim;
+		i += phase / interp;
+		phase %= interp;
+	}
+	next = i - count;
+
+	memmove(buf.data(), &buf[2 * count], sizeof(float) * 2 * history);
+	return n;
+}
+
+double rationalResampler::approximate(double ratio, int& interp, int& decim)
+{
+	// the last convergent of the continued fraction within the limit
+	double h0 = 0.0, h1 = 1.0, k0 = 1.0, k1 = 0.0;
+	double x = ratio;
+	interp = 1;
+	decim = 1;
+	for (int i = 0; i < 32; i++)
+	{
+		const double a = floor(x);
+		const double h2 = a * h1 + h0;
+		const double k2 = a * k1 + k0;
+		if (h2 > RESAMPLE_MAX_INTERP || k2 > 2 * RESAMPLE_MAX_INTERP)
+			break;
+		if (h2 > 0)
+		{
+			interp = (int)h2;
+			decim = (int)k2;
+		}
+		if (x - a < 1e-9)
+			break;
+		x = 1.0 / (x - a);
+		h0 = h1; h1 = h2;
+		k0 = k1; k1 = k2;
+	}
+	return (double)interp / decim;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "fft_backend.h"
+#include <vector>
+
+// largest interpolation of rationalResampler, in filter bank phases
+#define RESAMPLE_MAX_INTERP 256
+
+// rational resampling of a complex stream by interp / decim <= 1, for the
+// output rates between the power of 2 decimations. A polyphase filter bank
+// computes only the output samples, each from one phase of taps / interp
+// coefficients. Like halfbandCascade it keeps relPass of the output
+// Nyquist, what lies up to (2 - relPass) * Nyquist folds into the band
+// above relPass only.
+class rationalResampler {
+public:
+    // dot product of 'taps' samples with 'coef', which holds every tap
+    // twice, for I and Q; see r2iqKernels
+    typedef void (*firKernel)(const fftComplex* input, const float* coef, int taps, fftComplex* output);
+
+    rationalResampler() : interp(1), decim(1), taps(0), phase(0), next(0) {}
+
+    // designs the filter bank, interp == decim passes the stream through
+    void init(int interp, int decim, float Astop = 120.0f, float relPass = 0.85f);
+    void reset();   // clear the history, for a new stream
+
+    int getInterp() const { return interp; }
+    int getDecim() const { return decim; }
+    int getTaps() const { return taps * interp; }
+
+    // returns the number of output samples, at most count. out may be in
+    int process(const fftComplex* in, int count, fftComplex* out, firKernel fir);
+
+    // the closest interp / decim to a ratio from 0.5 to 1, with
+    // interp <= RESAMPLE_MAX_INTERP
+    static double approximate(double ratio, int& interp, int& decim);
+
+private:
+    int interp;
+    int decim;
+    int taps;                   // per phase
+    std::vector<float> coef;    // per phase 'taps' pairs, for the oldest input sample first
+    std::vector<float> buf;     // I/Q of the input history (taps - 1 samples), then the input
+    int phase;                  // of the next output sample
+    int next;                   // its oldest input sample in buf
+};
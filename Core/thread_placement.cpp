@@ -0,0 +1,426 @@
+#include "license.txt"
+
+#include "thread_placement.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <time.h>
+#endif
+
+namespace {
+	const char* const roleNames[THREAD_NROLES] = { "usb", "r2iq", "callback", "spectrum", "stats" };
+	const char* const policyNames[] = { "other", "fifo", "rr" };
+
+	// a running threadScope
+	struct scopeState {
+		size_t record;
+#if defined(_WIN32)
+		HANDLE thread;
+#else
+		clockid_t clock;
+#endif
+		bool live;          // whether other threads can read its clock
+	};
+
+	std::mutex mutex;
+	bool initialized = false;
+	threadPlacement placements[THREAD_NROLES];
+	bool warned[THREAD_NROLES];
+	std::vector<threadTime> records;    // without the running threads
+	std::vector<scopeState*> running;
+
+	// the cpus the process may run on, in order
+	std::vector<int> processCpus()
+	{
+		std::vector<int> cpus;
+#if defined(_WIN32)
+		DWORD_PTR process, system;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+		{
+			for (int n = 0; n < (int)sizeof(DWORD_PTR) * 8; n++)
+			{
+				if (process & ((DWORD_PTR)1 << n))
+					cpus.push_back(n);
+			}
+		}
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		{
+			for (int n = 0; n < CPU_SETSIZE; n++)
+			{
+				if (CPU_ISSET(n, &set))
+					cpus.push_back(n);
+			}
+		}
+#endif
+		return cpus;
+	}
+
+	// the default placements moved onto the cpus of the process
+	void initDefaults()
+	{
+		auto cpus = processCpus();
+		for (int r = 0; r < THREAD_NROLES; r++)
+		{
+			auto placement = threadDefaultPlacement((threadRole)r, (unsigned)cpus.size());
+			uint64_t mask = 0;
+			for (size_t i = 0; i < cpus.size() && i < 64; i++)
+			{
+				if ((placement.cpus >> i & 1) && cpus[i] < 64)
+					mask |= (uint64_t)1 << cpus[i];
+			}
+			placement.cpus = mask;
+			placements[r] = placement;
+		}
+	}
+
+	bool parseSpec(const char* spec, std::vector<std::pair<threadRole, threadPlacement>>& entries);
+
+	// under the mutex
+	void initialize()
+	{
+		if (initialized)
+			return;
+		initialized = true;
+		initDefaults();
+		const char* env = getenv("SDDC_THREADS");
+		if (env != nullptr && env[0] != 0)
+		{
+			std::vector<std::pair<threadRole, threadPlacement>> entries;
+			if (parseSpec(env, entries))
+			{
+				for (auto& entry : entries)
+					placements[entry.first] = entry.second;
+			}
+			else
+			{
+				DbgPrintf("threads: cannot parse SDDC_THREADS=%s\n", env);
+			}
+		}
+	}
+
+	// "0-3,6" or "any", up to the end or a ':'
+	bool parseCpus(const char*& s, uint64_t& cpus)
+	{
+		cpus = 0;
+		if (strncmp(s, "any", 3) == 0)
+		{
+			s += 3;
+			return true;
+		}
+		for (;;)
+		{
+			char* end;
+			long first = strtol(s, &end, 10);
+			if (end == s || first < 0 || first > 63)
+				return false;
+			long last = first;
+			s = end;
+			if (*s == '-')
+			{
+				s++;
+				last = strtol(s, &end, 10);
+				if (end == s || last < first || last > 63)
+					return false;
+				s = end;
+			}
+			for (long n = first; n <= last; n++)
+				cpus |= (uint64_t)1 << n;
+			if (*s != ',')
+				return true;
+			s++;
+		}
+	}
+
+	bool parseEntry(const char* s, const char* end, threadRole& role, threadPlacement& placement)
+	{
+		const char* eq = (const char*)memchr(s, '=', end - s);
+		if (eq == nullptr)
+			return false;
+		int r = 0;
+		while (r < THREAD_NROLES && !(strlen(roleNames[r]) == (size_t)(eq - s) && strncmp(roleNames[r], s, eq - s) == 0))
+			r++;
+		if (r == THREAD_NROLES)
+			return false;
+		role = (threadRole)r;
+
+		std::string text(eq + 1, end);
+		const char* p = text.c_str();
+		placement = threadPlacement();
+		if (!parseCpus(p, placement.cpus))
+			return false;
+		if (*p == ':')
+		{
+			p++;
+			int policy = 0;
+			while (policy < 3 && strncmp(p, policyNames[policy], strlen(policyNames[policy])) != 0)
+				policy++;
+			if (policy == 3)
+				return false;
+			placement.policy = (threadPolicy)policy;
+			p += strlen(policyNames[policy]);
+			placement.priority = (placement.policy == THREAD_OTHER) ? 0 : 1;
+			if (*p == ':')
+			{
+				char* num;
+				placement.priority = strtol(p + 1, &num, 10);
+				if (num == p + 1 || placement.priority < 1 || placement.priority > 99)
+					return false;
+				p = num;
+			}
+		}
+		return *p == 0;
+	}
+
+	bool parseSpec(const char* spec, std::vector<std::pair<threadRole, threadPlacement>>& entries)
+	{
+		const char* s = spec;
+		while (*s != 0)
+		{
+			const char* end = strchr(s, ';');
+			if (end == nullptr)
+				end = s + strlen(s);
+			if (end != s)
+			{
+				threadRole role;
+				threadPlacement placement;
+				if (!parseEntry(s, end, role, placement))
+					return false;
+				entries.push_back({ role, placement });
+			}
+			s = (*end != 0) ? end + 1 : end;
+		}
+		return true;
+	}
+
+	void apply(threadRole role, const threadPlacement& placement, const char* name)
+	{
+		bool failed = false;
+#if defined(_WIN32)
+		HANDLE self = GetCurrentThread();
+		if (placement.cpus != 0 && SetThreadAffinityMask(self, (DWORD_PTR)placement.cpus) == 0)
+			failed = true;
+		if (placement.policy != THREAD_OTHER)
+		{
+			const int priority = (placement.policy == THREAD_FIFO) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+			if (!SetThreadPriority(self, priority))
+				failed = true;
+		}
+		// Windows 10 1607 and later
+		typedef HRESULT (WINAPI *setThreadDescription)(HANDLE, PCWSTR);
+		auto describe = (setThreadDescription)GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+		if (describe != nullptr)
+		{
+			wchar_t wide[16];
+			MultiByteToWideChar(CP_UTF8, 0, name, -1, wide, 16);
+			wide[15] = 0;
+			describe(self, wide);
+		}
+#else
+		pthread_t self = pthread_self();
+		if (placement.cpus != 0)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (int n = 0; n < 64; n++)
+			{
+				if (placement.cpus >> n & 1)
+					CPU_SET(n, &set);
+			}
+			if (pthread_setaffinity_np(self, sizeof(set), &set) != 0)
+				failed = true;
+		}
+		if (placement.policy != THREAD_OTHER)
+		{
+			const int policy = (placement.policy == THREAD_FIFO) ? SCHED_FIFO : SCHED_RR;
+			sched_param param;
+			memset(&param, 0, sizeof(param));
+			param.sched_priority = placement.priority;
+			if (param.sched_priority < sched_get_priority_min(policy))
+				param.sched_priority = sched_get_priority_min(policy);
+			if (param.sched_priority > sched_get_priority_max(policy))
+				param.sched_priority = sched_get_priority_max(policy);
+			// EPERM without CAP_SYS_NICE or an rtprio limit
+			if (pthread_setschedparam(self, policy, &param) != 0)
+				failed = true;
+		}
+		char shortName[16];
+		strncpy(shortName, name, 15);
+		shortName[15] = 0;
+		pthread_setname_np(self, shortName);
+#endif
+		if (failed)
+		{
+			std::unique_lock<std::mutex> lk(mutex);
+			if (!warned[role])
+			{
+				warned[role] = true;
+				DbgPrintf("threads: %s keeps part of its placement, %s:%s:%d is not allowed\n",
+					name, roleNames[role], policyNames[placement.policy], placement.priority);
+			}
+		}
+	}
+
+	// under the mutex
+	double cpuSeconds(const scopeState* state)
+	{
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(state->thread, &creation, &exit, &kernel, &user))
+			return 0.0;
+		const uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+			((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+		return ticks * 1e-7;
+#else
+		timespec ts;
+		if (clock_gettime(state->clock, &ts) != 0)
+			return 0.0;
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+	}
+}
+
+threadPlacement threadDefaultPlacement(threadRole role, unsigned ncpu)
+{
+	// the USB transfers are short and must not wait, the other light
+	// threads share their cpu; the workers have the others to themselves,
+	// from 8 cpus on but one which is left to the application's callback
+	threadPlacement placement = { 0, THREAD_OTHER, 0 };
+	if (role == THREAD_USB)
+	{
+		placement.policy = THREAD_FIFO;
+		placement.priority = 50;
+	}
+	if (ncpu < 4)
+		return placement;
+
+	if (ncpu > 64)
+		ncpu = 64;
+	const unsigned workers = (ncpu >= 8) ? 2 : 1;
+	switch (role)
+	{
+	case THREAD_R2IQ:
+		for (unsigned n = workers; n < ncpu; n++)
+			placement.cpus |= (uint64_t)1 << n;
+		break;
+	case THREAD_CALLBACK:
+		placement.cpus = (uint64_t)1 << (workers - 1);
+		break;
+	default:
+		placement.cpus = 1;
+		break;
+	}
+	return placement;
+}
+
+threadPlacement threadGetPlacement(threadRole role)
+{
+	std::unique_lock<std::mutex> lk(mutex);
+	initialize();
+	return placements[role];
+}
+
+void threadSetPlacement(threadRole role, const threadPlacement& placement)
+{
+	std::unique_lock<std::mutex> lk(mutex);
+	initialize();
+	placements[role] = placement;
+	warned[role] = false;
+}
+
+bool threadParsePlacement(const char* spec)
+{
+	std::vector<std::pair<threadRole, threadPlacement>> entries;
+	if (!parseSpec(spec, entries))
+		return false;
+	for (auto& entry : entries)
+		threadSetPlacement(entry.first, entry.second);
+	return true;
+}
+
+unsigned threadCpuCount(threadRole role)
+{
+	uint64_t cpus = threadGetPlacement(role).cpus;
+	unsigned count = 0;
+	for (; cpus != 0; cpus &= cpus - 1)
+		count++;
+	return count;
+}
+
+threadScope::threadScope(threadRole role, const char* name)
+{
+	apply(role, threadGetPlacement(role), name);
+
+	auto st = new scopeState();
+#if defined(_WIN32)
+	st->live = DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &st->thread, 0, FALSE, DUPLICATE_SAME_ACCESS);
+	if (!st->live)
+		st->thread = GetCurrentThread();
+#else
+	st->live = (pthread_getcpuclockid(pthread_self(), &st->clock) == 0);
+	if (!st->live)
+		st->clock = CLOCK_THREAD_CPUTIME_ID;
+#endif
+
+	std::unique_lock<std::mutex> lk(mutex);
+	st->record = 0;
+	while (st->record < records.size() && strncmp(records[st->record].name, name, 15) != 0)
+		st->record++;
+	if (st->record == records.size())
+	{
+		threadTime record;
+		memset(&record, 0, sizeof(record));
+		strncpy(record.name, name, 15);
+		record.role = role;
+		records.push_back(record);
+	}
+	records[st->record].running++;
+	running.push_back(st);
+	state = st;
+}
+
+threadScope::~threadScope()
+{
+	auto st = (scopeState*)state;
+	std::unique_lock<std::mutex> lk(mutex);
+	for (size_t i = 0; i < running.size(); i++)
+	{
+		if (running[i] == st)
+		{
+			running.erase(running.begin() + i);
+			break;
+		}
+	}
+	records[st->record].seconds += cpuSeconds(st);
+	records[st->record].running--;
+#if defined(_WIN32)
+	if (st->live)
+		CloseHandle(st->thread);
+#endif
+	delete st;
+}
+
+int threadGetTimes(threadTime* times, int max)
+{
+	std::unique_lock<std::mutex> lk(mutex);
+	int count = 0;
+	for (; count < (int)records.size() && count < max; count++)
+		times[count] = records[count];
+	for (auto st : running)
+	{
+		if (st->live && (int)st->record < count)
+			times[st->record].seconds += cpuSeconds(st);
+	}
+	return count;
+}
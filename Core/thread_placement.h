@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+// Placement of the streaming threads: each role runs on a set of cpus
+// with a scheduling policy, the threads get names for top, perf and the
+// debuggers, and their cpu time is accounted. The defaults keep the USB
+// transfers and the light threads on the first cpu of the process and the
+// r2iq workers on the others; $SDDC_THREADS or threadSetPlacement()
+// change them. A placement the system refuses (no permission for a real
+// time policy, cpus outside of the process' set) is reported and the
+// thread runs on as it is.
+
+enum threadRole {
+    THREAD_USB,         // the USB transfers into the input ring
+    THREAD_R2IQ,        // the r2iq workers
+    THREAD_CALLBACK,    // the output callback of the application
+    THREAD_SPECTRUM,    // the spectrum callback
+    THREAD_STATS,       // the rate statistics and debug traces
+    THREAD_NROLES
+};
+
+enum threadPolicy {
+    THREAD_OTHER,       // the default time sharing
+    THREAD_FIFO,        // real time, SCHED_FIFO (time critical on Windows)
+    THREAD_RR,          // real time, SCHED_RR (highest on Windows)
+};
+
+struct threadPlacement {
+    uint64_t cpus;      // bit n for cpu n, 0 for any
+    threadPolicy policy;
+    int priority;       // of THREAD_FIFO and THREAD_RR, 1 .. 99
+};
+
+// the role's placement: the default for this host unless it is set
+threadPlacement threadGetPlacement(threadRole role);
+void threadSetPlacement(threadRole role, const threadPlacement& placement);
+// the default placements of a process running on its 'ncpu' first cpus
+threadPlacement threadDefaultPlacement(threadRole role, unsigned ncpu);
+
+// sets the placements of a list like "usb=0:fifo:50;r2iq=1-3,5;stats=any"
+// of role=cpus[:policy[:priority]], with the roles usb, r2iq, callback,
+// spectrum and stats and the policies other, fifo and rr. Read from
+// $SDDC_THREADS on first use. Returns false, and sets none, if one is wrong
+bool threadParsePlacement(const char* spec);
+
+// the number of cpus of the role's placement, 0 for any
+unsigned threadCpuCount(threadRole role);
+
+// one thread of a role, made first thing in the thread: it applies the
+// role's placement, names the thread (up to 15 characters) and accounts
+// its cpu time until it goes out of scope
+class threadScope {
+public:
+    threadScope(threadRole role, const char* name);
+    ~threadScope();
+
+private:
+    threadScope(const threadScope&) = delete;
+    threadScope& operator=(const threadScope&) = delete;
+
+    void* state;
+};
+
+struct threadTime {
+    char name[16];
+    threadRole role;
+    double seconds;     // of cpu time, summed over the threads of this name
+    int running;        // threads of this name running now
+};
+
+// the cpu time of the threads which ran in this process, by name in the
+// order they first started, at most 'max'. Returns the number of names
+int threadGetTimes(threadTime* times, int max);
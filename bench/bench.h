@@ -0,0 +1,81 @@
+#pragma once
+
+// small helpers shared by the benchmarks
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// run f() repeatedly for at least minSeconds, return seconds per call
+template<typename F> double bench_run(F f, double minSeconds = 0.5)
+{
+    using clock = std::chrono::steady_clock;
+
+    f(); // warm up caches and page in the buffers
+
+    long count = 0;
+    auto start = clock::now();
+    double elapsed;
+    do {
+        f();
+        count++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < minSeconds);
+
+    return elapsed / count;
+}
+
+// integer option "-x <value>" from the command line, or def
+static inline int bench_option(int argc, char **argv, const char *name, int def)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], name) == 0)
+            return atoi(argv[i + 1]);
+    }
+    return def;
+}
+
+// cycles per second of the time stamp counter, 0 if there is none
+static inline double bench_cycles_per_second()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    unsigned long long tsc = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    unsigned long long ticks = __rdtsc() - tsc;
+    return ticks / std::chrono::duration<double>(clock::now() - start).count();
+#else
+    return 0.0;
+#endif
+}
+
+// cpu time of all threads of the process in seconds
+static inline double bench_cpu_seconds()
+{
+#if defined(_WIN32)
+    FILETIME create, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user);
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
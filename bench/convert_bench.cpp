@@ -0,0 +1,132 @@
+// convert_bench: int16_t to float conversion of a whole transfer up front
+// versus per fft segment, each followed by the forward r2c fft of fft_mt_r2iq
+// with the default fft backend. The segment path also runs with the ADC
+// statistics of its new samples
+//
+// usage: convert_bench [-t threads] [-r 0|1]
+
+#include "fft_mt_r2iq.h"
+#include "config.h"
+#include "fft_backend.h"
+#include "fft_mt_r2iq_kernels.hpp"
+#include "bench.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+    // the default fft size of fft_mt_r2iq, segments 3/4 fft apart
+    const int halfFft = FFTN_R_ADC / 2;
+    const int fftPerBuf = transferSamples / (3 * halfFft / 2) + 1;
+
+    struct Buffers {
+        int16_t *adc;           // previous tail + transfer
+        float *block;           // whole transfer as float
+        float *segment;         // one fft segment as float
+        fftComplex *freq;
+
+        Buffers()
+        {
+            const int count = halfFft + transferSamples;
+            adc = new int16_t[count];
+            for (int i = 0; i < count; i++)
+                adc[i] = (int16_t)((i * 2654435761u) >> 18);
+            block = (float*)fftAlloc(sizeof(float) * (halfFft + transferSamples));
+            segment = (float*)fftAlloc(sizeof(float) * 2 * halfFft);
+            freq = (fftComplex*)fftAlloc(sizeof(fftComplex) * (halfFft + 1));
+        }
+        ~Buffers()
+        {
+            delete[] adc;
+            fftFree(block);
+            fftFree(segment);
+            fftFree(freq);
+        }
+    };
+
+    template<bool rand> void run_block(fftR2c* plan, Buffers& b)
+    {
+        convert_float<rand>(b.adc, b.block, halfFft + transferSamples);
+        for (int k = 0; k < fftPerBuf; k++)
+            plan->execute(b.block + (3 * halfFft / 2) * k, b.freq);
+    }
+
+    template<bool rand, bool stats> void run_segment(fftR2c* plan, Buffers& b)
+    {
+        adcStats adc;
+        const int statsBegin = stats ? halfFft / 2 : 2 * halfFft;
+        for (int k = 0; k < fftPerBuf; k++)
+        {
+            convert_segment<rand>(b.adc + halfFft, b.adc + halfFft, b.segment, (3 * halfFft / 2) * k - halfFft, 2 * halfFft,
+                statsBegin, 2 * halfFft, adc);
+            plan->execute(b.segment, b.freq);
+        }
+    }
+
+    // seconds per transfer with 'threads' workers running 'f' concurrently
+    template<typename F> double run_threads(int threads, F f)
+    {
+        std::vector<double> result(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back([&result, t, f]() { result[t] = bench_run(f, 1.0); });
+        double sum = 0.0;
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+            sum += result[t];
+        }
+        return sum / threads / threads;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int threads = bench_option(argc, argv, "-t", 1);
+    bool rand = bench_option(argc, argv, "-r", 0) != 0;
+
+    Buffers planBuf;
+    const fftBackend* backend = fftBackendFind(nullptr);
+    backend->beginPlans(2 * halfFft);
+    fftR2c* plan = backend->planR2c(2 * halfFft, planBuf.segment, planBuf.freq);
+    backend->endPlans(2 * halfFft);
+
+    auto block = [plan, rand]() {
+        static thread_local Buffers b;
+        if (rand) run_block<true>(plan, b); else run_block<false>(plan, b);
+    };
+    auto segment = [plan, rand]() {
+        static thread_local Buffers b;
+        if (rand) run_segment<true, false>(plan, b); else run_segment<false, false>(plan, b);
+    };
+    auto stats = [plan, rand]() {
+        static thread_local Buffers b;
+        if (rand) run_segment<true, true>(plan, b); else run_segment<false, true>(plan, b);
+    };
+
+    double tBlock = run_threads(threads, block);
+    double tSegment = run_threads(threads, segment);
+    double tStats = run_threads(threads, stats);
+
+    // float traffic per transfer: the whole block path writes the float copy
+    // and reads it back from outside L2; the segment path keeps its float
+    // segment (2 * halfFft) in L1/L2 and only streams the int16_t input
+    const double samples = transferSamples;
+    const double bytesBlock = sizeof(int16_t) * (halfFft + samples) + 2 * sizeof(float) * (halfFft + samples);
+    const double bytesSegment = sizeof(int16_t) * (halfFft + samples);
+
+    printf("%s kernels, %d thread(s), rand %d, %s fft %d, %d segments per transfer of %d samples\n",
+        R2IQ_KERNELS_NAME, threads, rand, backend->name(), 2 * halfFft, fftPerBuf, transferSamples);
+    printf("float working set: whole block %zu kB, per segment %zu kB\n",
+        sizeof(float) * (halfFft + transferSamples) / 1024, sizeof(float) * 2 * halfFft / 1024);
+    printf("%-14s %10s %10s %16s\n", "path", "ns/sample", "Msps", "stream B/sample");
+    printf("%-14s %10.3f %10.1f %16.2f\n", "whole block", tBlock * 1e9 / samples, samples / tBlock / 1e6, bytesBlock / samples);
+    printf("%-14s %10.3f %10.1f %16.2f\n", "per segment", tSegment * 1e9 / samples, samples / tSegment / 1e6, bytesSegment / samples);
+    printf("%-14s %10.3f %10.1f %16.2f\n", "+ ADC stats", tStats * 1e9 / samples, samples / tStats / 1e6, bytesSegment / samples);
+    printf("memory traffic saving %.0f%%, speedup %.2fx\n",
+        100.0 * (1.0 - bytesSegment / bytesBlock), tBlock / tSegment);
+    printf("ADC statistics %+.1f%%\n", 100.0 * (tStats / tSegment - 1.0));
+
+    delete plan;
+    return 0;
+}
@@ -0,0 +1,91 @@
+// fft_bench: the transforms of fft_mt_r2iq with each fft backend, FFTW
+// against pffft: the forward r2c of the whole fft and the inverse c2c of
+// every decimation
+//
+// usage: fft_bench [-n fft size]
+
+#include "fft_mt_r2iq.h"
+#include "config.h"
+#include "fft_backend.h"
+#include "pffft/pffft.h"
+#include "bench.h"
+
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    const int size = bench_option(argc, argv, "-n", FFTN_R_ADC);
+    const int halfFft = size / 2;
+
+    // the columns: r2c of size, then c2c of mfftdim[d] = halfFft >> d
+    std::vector<int> sizes = { size };
+    for (int d = 0; d < NDECIDX; d++)
+        sizes.push_back(halfFft >> d);
+
+    float *time = (float*)fftAlloc(sizeof(float) * size);
+    fftComplex *in = (fftComplex*)fftAlloc(sizeof(fftComplex) * halfFft);
+    fftComplex *out = (fftComplex*)fftAlloc(sizeof(fftComplex) * (halfFft + 1));
+
+    printf("ns per transform (ns per sample), pffft with %s\n", pffft_simd_arch());
+    printf("%-8s %16s", "backend", "r2c");
+    for (size_t k = 1; k < sizes.size(); k++)
+        printf(" %16s", "c2c inverse");
+    printf("\n%-8s", "");
+    for (int n : sizes)
+        printf(" %16d", n);
+    printf("\n");
+
+    std::vector<std::vector<double>> results;
+    for (auto list = fftBackendList(); *list != nullptr; list++)
+    {
+        const fftBackend& backend = **list;
+        std::vector<double> t;
+
+        // the input is destroyed, refill it with each call like the workers do
+        backend.beginPlans(size);
+        fftR2c *r2c = backend.planR2c(size, time, out);
+        t.push_back(bench_run([&]() {
+            for (int i = 0; i < size; i++)
+                time[i] = (float)((i * 2654435761u) >> 20 & 0xfff) - 2048.0f;
+            r2c->execute(time, out);
+        }));
+        delete r2c;
+
+        for (size_t k = 1; k < sizes.size(); k++)
+        {
+            const int n = sizes[k];
+            fftC2c *c2c = backend.planC2c(n, in, out, false);
+            t.push_back(bench_run([&]() {
+                for (int i = 0; i < n; i++)
+                {
+                    in[i][0] = (float)i;
+                    in[i][1] = (float)-i;
+                }
+                c2c->execute(in, out);
+            }));
+            delete c2c;
+        }
+        backend.endPlans(size);
+
+        printf("%-8s", backend.name());
+        for (size_t k = 0; k < sizes.size(); k++)
+            printf(" %8.0f (%5.2f)", t[k] * 1e9, t[k] * 1e9 / sizes[k]);
+        printf("\n");
+        results.push_back(t);
+    }
+
+    // against the default one, the first
+    printf("speed against %s:\n", fftBackendList()[0]->name());
+    for (size_t b = 0; b < results.size(); b++)
+    {
+        printf("%-8s", fftBackendList()[b]->name());
+        for (size_t k = 0; k < sizes.size(); k++)
+            printf(" %15.2fx", results[0][k] / results[b][k]);
+        printf("\n");
+    }
+
+    fftFree(time);
+    fftFree(in);
+    fftFree(out);
+    return 0;
+}
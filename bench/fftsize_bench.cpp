@@ -0,0 +1,107 @@
+// fftsize_bench: latency and cpu cost per input block of fft_mt_r2iq for
+// each fft size, with the filter length and ffts per block of the decimation
+//
+// latency: time from handing over an input block until its output block
+// is complete, with the engine otherwise idle.
+// cpu: cpu time of all threads per block while streaming as fast as the
+// workers go, and the load this means at the default ADC rate.
+//
+// usage: fftsize_bench [-t threads] [-d decimate] [-s seconds]
+
+#include "fft_mt_r2iq.h"
+#include "config.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    int threads = bench_option(argc, argv, "-t", 0);
+    int decimate = bench_option(argc, argv, "-d", 0);
+    int seconds = bench_option(argc, argv, "-s", 2);
+    const int blocksPerOutput = 1 << decimate;
+    const double blockSeconds = (double)transferSamples / DEFAULT_ADC_FREQ;
+
+    printf("decimate %d, %u ADC samples per block (%.0f us at %.0f Msps)\n",
+        decimate, transferSamples, blockSeconds * 1e6, DEFAULT_ADC_FREQ / 1e6);
+    printf("%8s %8s %10s %8s %8s %12s %12s %12s %10s %8s\n", "fft", "threads", "fft us", "taps", "ffts",
+        "latency us", "lat max us", "cpu us/blk", "Msps", "load %");
+
+    for (int size = FFTN_R_ADC_MIN; size <= FFTN_R_ADC_MAX; size *= 2)
+    {
+        ringbuffer<int16_t> input;
+        ringbuffer<float> output;
+        input.setBlockSize(transferSamples);
+        output.setBlockSize(EXT_BLOCKLEN * 2 * sizeof(float));
+        for (int i = 0; i < default_count; i++)
+        {
+            int16_t *p = input.peekPtr(i);
+            for (uint32_t n = 0; n < transferSamples; n++)
+                p[n] = (int16_t)((n * 2654435761u) >> 18);
+        }
+
+        fft_mt_r2iq r2iq;
+        r2iq.setThreads(threads);
+        r2iq.setFftSize(size);
+        r2iq.Init(1.0f, &input, &output);
+        r2iq.setDecimate(decimate);
+        r2iq.TurnOn();
+
+        using clock = std::chrono::steady_clock;
+
+        // latency: one output block at a time
+        std::vector<double> latency;
+        auto start = clock::now();
+        while (latency.size() < 20 || std::chrono::duration<double>(clock::now() - start).count() < 0.5)
+        {
+            for (int b = 0; b < blocksPerOutput; b++)
+            {
+                input.getWritePtr();
+                input.WriteDone();
+            }
+            auto t0 = clock::now();
+            output.getReadPtr();
+            latency.push_back(std::chrono::duration<double>(clock::now() - t0).count());
+            output.ReadDone();
+        }
+        std::sort(latency.begin(), latency.end());
+
+        // throughput: the producer keeps the input ring full
+        std::atomic<bool> run(true);
+        auto producer = std::thread([&input, &run]() {
+            while (run)
+            {
+                input.getWritePtr();
+                if (!run)
+                    break;
+                input.WriteDone();
+            }
+        });
+        long outputs = 0;
+        double cpu0 = bench_cpu_seconds();
+        start = clock::now();
+        double elapsed;
+        do {
+            output.getReadPtr();
+            output.ReadDone();
+            outputs++;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < seconds);
+        double cpu = bench_cpu_seconds() - cpu0;
+
+        run = false;
+        r2iq.TurnOff();
+        producer.join();
+
+        const double blocks = (double)outputs * blocksPerOutput;
+        printf("%8d %8d %10.1f %8d %8d %12.1f %12.1f %12.1f %10.1f %8.1f\n",
+            size, r2iq.getThreads(), size * 1e6 / DEFAULT_ADC_FREQ, r2iq.getFilterTaps(decimate), r2iq.getSegments(decimate),
+            latency[latency.size() / 2] * 1e6, latency.back() * 1e6,
+            cpu / blocks * 1e6, blocks * transferSamples / elapsed / 1e6,
+            100.0 * cpu / blocks / blockSeconds);
+    }
+
+    return 0;
+}
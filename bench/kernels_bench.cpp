@@ -0,0 +1,78 @@
+// kernels_bench: cycles per sample of the r2iq inner loop kernels for each
+// instruction set this cpu runs, against the scalar reference
+//
+// usage: kernels_bench
+
+#include "fft_mt_r2iq.h"
+#include "config.h"
+#include "fft_backend.h"
+#include "bench.h"
+
+#include <vector>
+
+int main()
+{
+    // one fft segment, as processed per call by the workers
+    const int size = FFTN_R_ADC;
+
+    std::vector<int16_t> adc(size);
+    for (int i = 0; i < size; i++)
+        adc[i] = (int16_t)((i * 2654435761u) >> 18);
+    float *out = (float*)fftAlloc(sizeof(float) * 2 * size);
+    fftComplex *a = (fftComplex*)fftAlloc(sizeof(fftComplex) * size);
+    fftComplex *b = (fftComplex*)fftAlloc(sizeof(fftComplex) * size);
+    fftComplex *c = (fftComplex*)out;
+    for (int i = 0; i < size; i++)
+    {
+        a[i][0] = (float)i; a[i][1] = (float)-i;
+        b[i][0] = 0.5f; b[i][1] = 0.25f;
+    }
+
+    double hz = bench_cycles_per_second();
+    const char *unit = (hz > 0.0) ? "cycles/sample" : "ns/sample";
+    double scale = (hz > 0.0) ? hz : 1e9;
+    printf("%d samples per call, %s\n", size, unit);
+    printf("%-8s %12s %12s %12s %12s %12s %12s %12s %12s\n", "isa", "convert", "convert rand", "+ ADC stats", "filter mul", "filter conj", "copy", "copy conj", "resample");
+
+    struct Result {
+        const r2iqKernels* kernels;
+        double t[8];    // seconds per call
+    };
+    std::vector<Result> results;
+    for (auto list = r2iqKernelList(); *list != nullptr; list++)
+    {
+        const r2iqKernels& k = **list;
+        Result r = { &k, {} };
+        r.t[0] = bench_run([&]() { k.convert_float[0](adc.data(), out, size); });
+        r.t[1] = bench_run([&]() { k.convert_float[1](adc.data(), out, size); });
+        adcStats stats;
+        r.t[2] = bench_run([&]() { k.convert_stats[0](adc.data(), out, size, &stats); });
+        r.t[3] = bench_run([&]() { k.shift_freq[0](c, a, b, 0, size); });
+        r.t[4] = bench_run([&]() { k.shift_freq[1](c, a, b, 0, size); });
+        r.t[5] = bench_run([&]() { k.copy[0](c, a, size); });
+        r.t[6] = bench_run([&]() { k.copy[1](c, a, size); });
+        r.t[7] = bench_run([&]() { k.fir(a, (const float*)b, size, c); });   // per tap
+        results.push_back(r);
+
+        printf("%-8s", k.name);
+        for (int i = 0; i < 8; i++)
+            printf(" %12.3f", r.t[i] * scale / size);
+        printf("\n");
+    }
+
+    // the scalar reference is the last one
+    const Result& ref = results.back();
+    printf("speedup against %s:\n", ref.kernels->name);
+    for (const auto& r : results)
+    {
+        printf("%-8s", r.kernels->name);
+        for (int i = 0; i < 8; i++)
+            printf(" %11.2fx", ref.t[i] / r.t[i]);
+        printf("\n");
+    }
+
+    fftFree(out);
+    fftFree(a);
+    fftFree(b);
+    return 0;
+}
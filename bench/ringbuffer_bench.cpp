@@ -0,0 +1,175 @@
+// ringbuffer_bench: handoff latency and throughput of the ring buffer
+// between two threads, against the mutex and condition variable ring it
+// replaced
+//
+// latency: a block goes through one ring and comes back through another,
+// half of the round trip, with the other thread waiting for it.
+// throughput: blocks per second from a writer to a reader, with an empty
+// block and with 1024 samples written and checked like the unit tests do.
+// cpu: cpu time of both threads per block.
+//
+// usage: ringbuffer_bench [-n blocks] [-c ring count]
+
+#include "dsp/ringbuffer.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    // the previous ring: volatile indices, a short spin, and a mutex on
+    // every handover
+    class mutexRing {
+    public:
+        mutexRing(int count) : max_count(count), read_index(0), write_index(0), buffers(count) {}
+
+        void setBlockSize(int size)
+        {
+            for (auto& b : buffers)
+                b.resize(size);
+        }
+        int getBlockSize() const { return (int)buffers[0].size(); }
+
+        int16_t* getWritePtr()
+        {
+            for (int i = 0; i < spin_count; i++)
+            {
+                if ((write_index + 1) % max_count != read_index)
+                    return buffers[write_index].data();
+            }
+            std::unique_lock<std::mutex> lk(mutex);
+            nonfullCV.wait(lk, [this] { return (write_index + 1) % max_count != read_index; });
+            return buffers[write_index].data();
+        }
+
+        const int16_t* getReadPtr()
+        {
+            for (int i = 0; i < spin_count; i++)
+            {
+                if (read_index != write_index)
+                    return buffers[read_index].data();
+            }
+            std::unique_lock<std::mutex> lk(mutex);
+            nonemptyCV.wait(lk, [this] { return read_index != write_index; });
+            return buffers[read_index].data();
+        }
+
+        void ReadDone()
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            read_index = (read_index + 1) % max_count;
+            nonfullCV.notify_all();
+        }
+
+        void WriteDone()
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            write_index = (write_index + 1) % max_count;
+            nonemptyCV.notify_all();
+        }
+
+    private:
+        int max_count;
+        volatile int read_index;
+        volatile int write_index;
+        std::vector<std::vector<int16_t>> buffers;
+        std::mutex mutex;
+        std::condition_variable nonemptyCV;
+        std::condition_variable nonfullCV;
+    };
+
+    using clock = std::chrono::steady_clock;
+
+    // median and 99th percentile of the one way latency in us
+    template<typename Ring> void latency(int blocks, double& median, double& p99)
+    {
+        Ring ping(2), pong(2);
+        ping.setBlockSize(64);
+        pong.setBlockSize(64);
+        auto echo = std::thread([&ping, &pong, blocks]() {
+            for (int i = 0; i < blocks; i++)
+            {
+                const int16_t* in = ping.getReadPtr();
+                int16_t* out = pong.getWritePtr();
+                out[0] = in[0];
+                ping.ReadDone();
+                pong.WriteDone();
+            }
+        });
+
+        std::vector<double> times(blocks);
+        for (int i = 0; i < blocks; i++)
+        {
+            auto t0 = clock::now();
+            ping.getWritePtr()[0] = (int16_t)i;
+            ping.WriteDone();
+            pong.getReadPtr();
+            pong.ReadDone();
+            times[i] = std::chrono::duration<double>(clock::now() - t0).count() / 2;
+        }
+        echo.join();
+
+        std::sort(times.begin(), times.end());
+        median = times[blocks / 2] * 1e6;
+        p99 = times[blocks * 99 / 100] * 1e6;
+    }
+
+    // blocks per second, and cpu us per block
+    template<typename Ring> void throughput(int blocks, int count, int size, double& rate, double& cpu)
+    {
+        Ring ring(count);
+        ring.setBlockSize(std::max(size, 1));
+        const double cpu0 = bench_cpu_seconds();
+        auto start = clock::now();
+        auto writer = std::thread([&ring, blocks, size]() {
+            for (int i = 0; i < blocks; i++)
+            {
+                int16_t* ptr = ring.getWritePtr();
+                memset(ptr, 0x5A, size * sizeof(int16_t));
+                ring.WriteDone();
+            }
+        });
+        int errors = 0;
+        for (int i = 0; i < blocks; i++)
+        {
+            const int16_t* ptr = ring.getReadPtr();
+            if (size > 0)
+                errors += (ptr[size - 1] != 0x5A5A);
+            ring.ReadDone();
+        }
+        writer.join();
+        const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        if (errors > 0)
+            printf("%d blocks wrong\n", errors);
+        rate = blocks / elapsed;
+        cpu = (bench_cpu_seconds() - cpu0) / blocks * 1e6;
+    }
+
+    template<typename Ring> void run(const char* name, int blocks, int count)
+    {
+        double median, p99;
+        latency<Ring>(blocks / 10, median, p99);
+        printf("%-10s %12.2f %12.2f", name, median, p99);
+        for (int size : { 0, 1024 })
+        {
+            double rate, cpu;
+            throughput<Ring>(blocks, count, size, rate, cpu);
+            printf(" %12.0f %10.2f", rate / 1e3, cpu);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int blocks = bench_option(argc, argv, "-n", 1000000);
+    const int count = bench_option(argc, argv, "-c", default_count);
+
+    printf("%d blocks, ring of %d, %u cpus\n", blocks, count, std::thread::hardware_concurrency());
+    printf("%-10s %12s %12s %12s %10s %12s %10s\n", "", "latency us", "p99 us",
+        "kblk/s", "cpu us", "kblk/s 1024", "cpu us");
+    run<mutexRing>("mutex", blocks, count);
+    run<ringbuffer<int16_t>>("lock-free", blocks, count);
+
+    return 0;
+}
@@ -8,34 +8,31 @@ struct sddc
     SDDCStatus status;
     RadioHandlerClass* handler;
     uint8_t led;
-    int samplerateidx;
+    int decimate;       // output rate adc / 2 / 2^decimate
+    int interp;         // resampled by interp / decim
+    int decim;
     double freq;
 
     sddc_read_async_cb_t callback;
     void *callback_context;
+    sddc_spectrum_cb_t spectrum_callback;
+    void *spectrum_context;
 };
 
 sddc_t *current_running;
 
 static void Callback(void* context, const float* data, uint32_t len)
 {
+    sddc_t *t = (sddc_t*)context;
+    if (t->callback != nullptr)
+        t->callback(len * 2 * sizeof(float), (uint8_t*)data, t->callback_context);
 }
 
-class rawdata : public r2iqControlClass {
-    void Init(float gain, ringbuffer<int16_t>* buffers, ringbuffer<float>* obuffers) override
-    {
-        idx = 0;
-    }
-
-    void TurnOn() override
-    {
-        this->r2iqOn = true;
-        idx = 0;
-    }
-
-private:
-    int idx;
-};
+static void SpectrumCallback(void* context, const float* power, uint32_t bins)
+{
+    sddc_t *t = (sddc_t*)context;
+    t->spectrum_callback(bins, power, t->spectrum_context);
+}
 
 int sddc_get_device_count()
 {
@@ -94,10 +91,14 @@ sddc_t *sddc_open(int index, const char* imagefile)
 
     ret_val->handler = new RadioHandlerClass();
 
-    if (ret_val->handler->Init(fx3, Callback, new rawdata()))
+    // the default fft_mt_r2iq: the half-band stages, the resampler, the
+    // ADC statistics and the spectrum all run in it
+    if (ret_val->handler->Init(fx3, Callback, nullptr, ret_val))
     {
         ret_val->status = SDDC_STATUS_READY;
-        ret_val->samplerateidx = 0;
+        ret_val->decimate = 4;  // 2 Msps at 64 Msps
+        ret_val->interp = 1;
+        ret_val->decim = 1;
     }
 
     return ret_val;
@@ -246,6 +247,19 @@ int sddc_set_adc_random(sddc_t *t, int random)
     return 0;
 }
 
+int sddc_get_adc_stats(sddc_t *t, struct sddc_adc_stats *stats, int reset)
+{
+    static_assert(SDDC_ADC_LEVELS == ADC_LEVELS, "ADC levels");
+    auto adc = t->handler->GetAdcStats(reset != 0);
+    stats->samples = adc.samples;
+    stats->clipped = adc.clipped;
+    stats->min = adc.min;
+    stats->max = adc.max;
+    for (int n = 0; n < ADC_LEVELS; n++)
+        stats->levels[n] = adc.levels[n];
+    return 0;
+}
+
 /* HF block functions */
 double sddc_get_hf_attenuation(sddc_t *t)
 {
@@ -328,31 +342,22 @@ int sddc_set_vhf_bias(sddc_t *t, int bias)
 
 double sddc_get_sample_rate(sddc_t *t)
 {
-    return 0;
+    return t->handler->getSampleRate() / 2.0 / (1 << t->decimate) * t->interp / t->decim;
 }
 
+/* any rate from adc / 2 down to 31.25 kHz at 64 Msps, see PlanSampleRate() */
 int sddc_set_sample_rate(sddc_t *t, double sample_rate)
 {
-    switch((int64_t)sample_rate)
-    {
-        case 32000000:
-            t->samplerateidx = 0;
-            break;
-        case 16000000:
-            t->samplerateidx = 1;
-            break;
-        case 8000000:
-            t->samplerateidx = 2;
-            break;
-        case 4000000:
-            t->samplerateidx = 3;
-            break;
-        case 2000000:
-            t->samplerateidx = 4;
-            break;
-        default:
-            return -1;
-    }
+    int decimate, interp, decim;
+    if (t->handler->PlanSampleRate(sample_rate, decimate, interp, decim) == 0.0)
+        return -1;
+
+    // while streaming without a restart
+    if (current_running == t && !t->handler->UpdateDecimation(decimate, interp, decim))
+        return -1;
+    t->decimate = decimate;
+    t->interp = interp;
+    t->decim = decim;
     return 0;
 }
 
@@ -366,10 +371,25 @@ int sddc_set_async_params(sddc_t *t, uint32_t frame_size,
     return 0;
 }
 
+int sddc_set_spectrum_params(sddc_t *t, uint32_t bins, double frame_rate,
+                             sddc_spectrum_cb_t callback,
+                             void *callback_context)
+{
+    if (callback != nullptr && (bins == 0 || bins > FFTN_R_ADC / 2 || (bins & (bins - 1)) != 0 || frame_rate <= 0.0))
+        return -1;
+
+    t->spectrum_callback = callback;
+    t->spectrum_context = callback_context;
+    if (!t->handler->SetSpectrum(bins, (float)frame_rate, callback != nullptr ? SpectrumCallback : nullptr, t))
+        return -1;
+    return 0;
+}
+
 int sddc_start_streaming(sddc_t *t)
 {
+    if (!t->handler->StartDecimation(t->decimate, t->interp, t->decim))
+        return -1;
     current_running = t;
-    t->handler->Start(t->samplerateidx);
     return 0;
 }
 
@@ -60,6 +60,19 @@ enum RFMode {
   VHF_MODE
 };
 
+/* ADC input statistics, see sddc_get_adc_stats() */
+#define SDDC_ADC_LEVELS 8
+
+struct sddc_adc_stats {
+  uint64_t samples;
+  uint64_t clipped;   /* at the lowest or the highest code */
+  int16_t min;        /* above max without samples */
+  int16_t max;
+  /* samples by peak level in 6 dB steps from full scale, the last one
+     takes all below -42 dBFS */
+  uint64_t levels[SDDC_ADC_LEVELS];
+};
+
 enum LEDColors {
   YELLOW_LED = 0x01,
   RED_LED    = 0x02,
@@ -109,6 +122,10 @@ int sddc_get_adc_random(sddc_t *t);
 
 int sddc_set_adc_random(sddc_t *t, int random);
 
+/* since the start of streaming or the last reset (reset != 0 starts over);
+   lock free, callable from any thread while streaming */
+int sddc_get_adc_stats(sddc_t *t, struct sddc_adc_stats *stats, int reset);
+
 
 /* HF block functions */
 double sddc_get_hf_attenuation(sddc_t *t);
@@ -143,17 +160,39 @@ int sddc_set_vhf_bias(sddc_t *t, int bias);
 
 
 /* streaming functions */
+
+/* the DDC output: complex float samples (cf32), I and Q interleaved, at
+   sddc_get_sample_rate(); data_size is in bytes, 8 per sample */
 typedef void (*sddc_read_async_cb_t)(uint32_t data_size, uint8_t *data,
                                       void *context);
 
 double sddc_get_sample_rate(sddc_t *t);
 
+/* up to the ADC rate / 2, down to 31.25 ksps at 64 Msps: below 2 Msps
+   through half-band stages, the rates between the ADC rate / 2 / 2^n are
+   resampled, sddc_get_sample_rate() returns the exact one. While streaming
+   the new rate follows without a restart */
 int sddc_set_sample_rate(sddc_t *t, double sample_rate);
 
 int sddc_set_async_params(sddc_t *t, uint32_t frame_size, 
                           uint32_t num_frames, sddc_read_async_cb_t callback,
                           void *callback_context);
 
+/* wideband power spectrum of the whole ADC band next to the stream: 'bins'
+   (a power of 2 up to half the DDC fft size) from 0 to the ADC rate / 2,
+   averaged to about 'frame_rate' frames per second. The power is relative
+   to a full scale ADC sine, which adds up to 1.0 (0 dBFS) over the bins it
+   falls into. The callback runs in its own thread, frames it does not keep
+   up with are dropped. A NULL callback turns it off, it takes effect with
+   the next sddc_start_streaming(). -1, and off, if the DDC cannot deliver
+   these bins */
+typedef void (*sddc_spectrum_cb_t)(uint32_t bins, const float *power,
+                                   void *context);
+
+int sddc_set_spectrum_params(sddc_t *t, uint32_t bins, double frame_rate,
+                             sddc_spectrum_cb_t callback,
+                             void *callback_context);
+
 int sddc_start_streaming(sddc_t *t);
 
 int sddc_handle_events(sddc_t *t);
@@ -0,0 +1,320 @@
+/*
+ * sddc_ddc - offline DDC of raw ADC captures
+ *
+ * Reads the 16 bit ADC samples of a WAV file, like sddc_stream_test
+ * writes them, or of a raw binary file through a memory mapping and runs
+ * them through the r2iq as fast as all cores go. The r2iq splits the
+ * stream into blocks which overlap the previous one, its worker threads
+ * transform them in parallel and commit them in order, so the IQ output
+ * is the same as the one of a live stream.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fft_mt_r2iq.h"
+#include "thread_placement.h"
+#include "wavehdr.h"
+#include "wavewrite.h"
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [options] <input file> <output file>\n", name);
+  fprintf(stderr, "  -r  ADC sample rate in Hz, for a raw input (a WAV file has it)\n");
+  fprintf(stderr, "  -d  decimation 0 .. %d, the output rate is ADC rate / 2^(d + 1) (default 4)\n", NDECIMATE - 1);
+  fprintf(stderr, "  -f  tuned frequency in Hz, 0 .. ADC rate / 2 (default ADC rate / 8)\n");
+  fprintf(stderr, "  -l  lower sideband\n");
+  fprintf(stderr, "  -F  output format cf32, cs16, cs8 or cf16 (default cf32)\n");
+  fprintf(stderr, "  -t  worker threads (default all cores, at most %d)\n", N_MAX_R2IQ_THREADS);
+  fprintf(stderr, "  -P  thread placement like SDDC_THREADS, \"usb=0;r2iq=1-3\" (default any cpu)\n");
+  fprintf(stderr, "  -R  ADC randomizer on\n");
+  fprintf(stderr, "an output file ending with .wav gets 16 bit I/Q samples and a WAV header\n");
+}
+
+// read only mapping of a whole file
+struct mappedFile {
+  const uint8_t *data = nullptr;
+  uint64_t size = 0;
+#if _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+
+  bool open(const char *name)
+  {
+#if _WIN32
+    file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+      return false;
+    size = length.QuadPart;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+      return false;
+    data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    return data != nullptr;
+#else
+    int fd = ::open(name, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    size = st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+    data = (const uint8_t *)map;
+    return true;
+#endif
+  }
+
+  ~mappedFile()
+  {
+#if _WIN32
+    if (data != nullptr)
+      UnmapViewOfFile(data);
+    if (mapping != nullptr)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+#else
+    if (data != nullptr)
+      munmap((void *)data, size);
+#endif
+  }
+};
+
+// the samples of a 16 bit mono PCM WAV file, false if it is none. The size
+// of a data chunk beyond 4 GB does not fit into its header, the data then
+// take the rest of the file
+static bool findWaveData(const mappedFile &file, uint64_t &offset, uint64_t &bytes, uint32_t &rate)
+{
+  if (file.size < sizeof(riff_chunk) || memcmp(file.data, "RIFF", 4) != 0 || memcmp(file.data + 8, "WAVE", 4) != 0)
+    return false;
+
+  bool pcm16 = false;
+  uint64_t pos = sizeof(riff_chunk);
+  while (pos + sizeof(chunk_hdr) <= file.size) {
+    chunk_hdr hdr;
+    memcpy(&hdr, file.data + pos, sizeof(hdr));
+    pos += sizeof(hdr);
+    if (memcmp(hdr.ID, "fmt ", 4) == 0 && pos + sizeof(fmt_chunk) - sizeof(chunk_hdr) <= file.size) {
+      fmt_chunk fmt;
+      memcpy(&fmt, file.data + pos - sizeof(hdr), sizeof(fmt));
+      pcm16 = (fmt.wFormatTag == 1 && fmt.nChannels == 1 && fmt.nBitsPerSample == 16);
+      rate = fmt.nSamplesPerSec;
+    } else if (memcmp(hdr.ID, "data", 4) == 0) {
+      offset = pos;
+      bytes = hdr.size;
+      if (bytes == 0 || offset + bytes > file.size || file.size - offset > UINT32_MAX)
+        bytes = file.size - offset;
+      return pcm16;
+    }
+    pos += hdr.size + (hdr.size & 1);
+  }
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  double adcRate = 0.0;
+  double frequency = -1.0;
+  int decimate = 4;
+  bool lsb = false;
+  bool randomizer = false;
+  // all cores by default, up to the workers the r2iq runs
+  int threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), N_MAX_R2IQ_THREADS));
+  r2iqOutputFormat format;
+  const char *inName = nullptr;
+  const char *outName = nullptr;
+
+  // no real time here, the feeder and the workers share all cores
+  if (getenv("SDDC_THREADS") == nullptr)
+    threadParsePlacement("usb=any;r2iq=any");
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      adcRate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      decimate = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      frequency = atof(argv[++i]);
+    } else if (strcmp(argv[i], "-l") == 0) {
+      lsb = true;
+    } else if (strcmp(argv[i], "-R") == 0) {
+      randomizer = true;
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+      if (!threadParsePlacement(argv[++i])) {
+        usage(argv[0]);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+      static const char *names[NFORMAT] = { "cf32", "cs16", "cs8", "cf16" };
+      const char *name = argv[++i];
+      int f = 0;
+      while (f < NFORMAT && strcmp(name, names[f]) != 0)
+        f++;
+      if (f == NFORMAT) {
+        usage(argv[0]);
+        return -1;
+      }
+      format.format = (r2iqFormat)f;
+    } else if (argv[i][0] != '-' && inName == nullptr) {
+      inName = argv[i];
+    } else if (argv[i][0] != '-' && outName == nullptr) {
+      outName = argv[i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (inName == nullptr || outName == nullptr || decimate < 0 || decimate >= NDECIMATE ||
+      threads < 1 || threads > N_MAX_R2IQ_THREADS) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  mappedFile input;
+  if (!input.open(inName)) {
+    fprintf(stderr, "ERROR - cannot map %s\n", inName);
+    return -1;
+  }
+  uint64_t offset = 0;
+  uint64_t bytes = input.size;
+  uint32_t waveRate = 0;
+  if (findWaveData(input, offset, bytes, waveRate)) {
+    if (adcRate == 0.0)
+      adcRate = waveRate;
+  } else if (memcmp(input.data, "RIFF", 4) == 0) {
+    fprintf(stderr, "ERROR - %s is no 16 bit mono PCM WAV file\n", inName);
+    return -1;
+  }
+  if (adcRate <= 0.0) {
+    fprintf(stderr, "ERROR - the ADC sample rate of a raw input is missing (-r)\n");
+    return -1;
+  }
+  if (frequency < 0.0)
+    frequency = adcRate / 8.0;
+  if (frequency > adcRate / 2.0) {
+    fprintf(stderr, "ERROR - the frequency is above ADC rate / 2\n");
+    return -1;
+  }
+
+  const bool wave = strlen(outName) > 4 && strcmp(outName + strlen(outName) - 4, ".wav") == 0;
+  if (wave) {
+    format.format = FORMAT_CS16;
+    format.planar = false;
+  }
+  FILE *out = fopen(outName, "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "ERROR - cannot create %s\n", outName);
+    return -1;
+  }
+
+  const double outRate = adcRate / (2 << decimate);
+  if (wave)
+    waveWriteHeader((unsigned)(0.5 + outRate), (unsigned)(0.5 + frequency), 16, 2, out);
+
+  // all of the output of the samples, the blocks after the last one are zero
+  const uint64_t samples = bytes / sizeof(int16_t);
+  const uint64_t outSamples = samples >> (decimate + 1);
+  const int16_t *adc = (const int16_t *)(input.data + offset);
+
+  ringbuffer<int16_t> inputbuffer;
+  ringbuffer<float> outputbuffer;
+  inputbuffer.setBlockSize(transferSamples);
+  outputbuffer.setBlockSize(EXT_BLOCKLEN * format.sampleBytes());
+
+  fft_mt_r2iq r2iq;
+  r2iq.setThreads(threads);
+  r2iq.Init(1.0f, &inputbuffer, &outputbuffer);
+  r2iq.setDecimate(decimate);
+  r2iq.setSideband(lsb);
+  r2iq.setOutputFormat(format);
+  r2iq.updateRand(randomizer);
+  r2iq.setFreqOffset((float)(frequency / (adcRate / 2.0)));
+
+  printf("%s: %llu samples at %.0f Hz, %s %.0f Hz at %.0f Hz, %d threads\n", inName,
+         (unsigned long long)samples, adcRate, lsb ? "lsb" : "usb", frequency, outRate, threads);
+
+  auto start = std::chrono::steady_clock::now();
+  r2iq.TurnOn();
+
+  std::atomic<bool> run(true);   // read by the feeder
+  std::thread feeder([&]() {
+    threadScope scope(THREAD_USB, "sddc-feeder");
+    uint64_t pos = 0;
+    while (run) {
+      auto ptr = inputbuffer.getWritePtr();
+      if (!run)
+        break;
+      const uint64_t count = (pos < samples) ? std::min<uint64_t>(samples - pos, transferSamples) : 0;
+      memcpy(ptr, adc + pos, count * sizeof(int16_t));
+      memset(ptr + count, 0, (transferSamples - count) * sizeof(int16_t));
+      pos += count;
+      inputbuffer.WriteDone();
+    }
+  });
+
+  int result = 0;
+  for (uint64_t written = 0; written < outSamples && result == 0; ) {
+    auto ptr = outputbuffer.getReadPtr();
+    const size_t count = (size_t)std::min<uint64_t>(outSamples - written, EXT_BLOCKLEN);
+    if (wave)
+      result = waveWriteFrames(out, (void *)ptr, count, 0);
+    else if (fwrite(ptr, format.sampleBytes(), count, out) != count)
+      result = -1;
+    outputbuffer.ReadDone();
+    written += count;
+  }
+
+  run = false;
+  r2iq.TurnOff();
+  feeder.join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (wave && result == 0)
+    result = waveFinalizeHeader(out);
+  if (fclose(out) != 0)
+    result = -1;
+  if (result != 0) {
+    fprintf(stderr, "ERROR - writing %s failed\n", outName);
+    return -1;
+  }
+
+  const adcStats stats = r2iq.getAdcStats();
+  printf("%s: %llu IQ samples in %.1f s, %.1f times real time, ADC %d .. %d, %llu clipped\n", outName,
+         (unsigned long long)outSamples, elapsed.count(), samples / adcRate / elapsed.count(),
+         stats.min, stats.max, (unsigned long long)stats.clipped);
+
+  threadTime times[N_MAX_R2IQ_THREADS + 1];
+  const int count = threadGetTimes(times, N_MAX_R2IQ_THREADS + 1);
+  for (int i = 0; i < count; i++)
+    printf("  %-12s %6.2f s cpu, %3.0f%% of the time\n", times[i].name, times[i].seconds,
+           100.0 * times[i].seconds / elapsed.count());
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * sddc_plan - precompute the FFTW wisdom of the r2iq fft sizes
+ *
+ * The plans are measured once per cpu model and fft size into the wisdom
+ * cache, the DDC then starts without measuring them.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "fft_mt_r2iq.h"
+#include "fftw_wisdom.h"
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-d <wisdom dir>] [-s <fft size>] [-e]\n", name);
+  fprintf(stderr, "  -d  wisdom cache directory (default %s)\n", fftwWisdom::getDir().c_str());
+  fprintf(stderr, "  -s  plan only this fft size (default all, %d .. %d)\n", FFTN_R_ADC_MIN, FFTN_R_ADC_MAX);
+  fprintf(stderr, "  -e  FFTW_EXHAUSTIVE instead of FFTW_PATIENT\n");
+}
+
+int main(int argc, char **argv)
+{
+  int minSize = FFTN_R_ADC_MIN;
+  int maxSize = FFTN_R_ADC_MAX;
+  unsigned planner = FFTW_PATIENT;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      fftwWisdom::setDir(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      minSize = maxSize = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-e") == 0) {
+      planner = FFTW_EXHAUSTIVE;
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  fftwWisdom::setPlanner(planner);
+  printf("cpu %s, %s\n", fftwWisdom::cpuName().c_str(),
+         planner == FFTW_EXHAUSTIVE ? "FFTW_EXHAUSTIVE" : "FFTW_PATIENT");
+
+  ringbuffer<int16_t> input;
+  ringbuffer<float> output;
+  input.setBlockSize(transferSamples);
+  output.setBlockSize(EXT_BLOCKLEN * 2 * sizeof(float));
+
+  for (int size = minSize; size <= maxSize; size *= 2) {
+    fft_mt_r2iq r2iq;
+    r2iq.setFftBackend("fftw");
+    if (!r2iq.setFftSize(size)) {
+      fprintf(stderr, "ERROR - fft size %d is not supported\n", size);
+      return -1;
+    }
+
+    // plan from scratch, each file holds the wisdom of its size only
+    fftwWisdom::remove(size);
+
+    auto start = std::chrono::steady_clock::now();
+    r2iq.Init(1.0f, &input, &output);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("fft %6d: %7.1f s, %s\n", size, elapsed.count(), fftwWisdom::fileName(size).c_str());
+  }
+
+  return 0;
+}
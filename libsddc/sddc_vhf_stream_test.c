@@ -99,7 +99,7 @@ static void count_bytes_callback(uint32_t data_size, uint8_t *data,
 static unsigned long long received_samples = 0;
 static unsigned long long total_samples = 0;
 static int num_callbacks;
-static int16_t *sampleData = 0;
+static float *sampleData = 0;   /* interleaved I and Q */
 static int runtime = 3000;
 static struct timespec clk_start, clk_end;
 static int stop_reception = 0;
@@ -147,6 +147,9 @@ int main(int argc, char **argv)
     goto DONE;
   }
 
+  /* the exact rate, the DDC resamples to the rates in between */
+  sample_rate = sddc_get_sample_rate(sddc);
+
   if (sddc_set_async_params(sddc, 0, 0, count_bytes_callback, sddc) < 0) {
     fprintf(stderr, "ERROR - sddc_set_async_params() failed\n");
     goto DONE;
@@ -178,7 +181,7 @@ int main(int argc, char **argv)
   total_samples = (unsigned long long)(runtime * sample_rate / 1000.0);
 
   if (outfilename)
-    sampleData = (int16_t*)malloc(total_samples * sizeof(int16_t));
+    sampleData = (float*)malloc(total_samples * 2 * sizeof(float));
 
   /* todo: move this into a thread */
   stop_reception = 0;
@@ -193,17 +196,34 @@ int main(int argc, char **argv)
   }
 
   double dur = clk_diff();
-  fprintf(stderr, "received=%llu 16-Bit samples in %d callbacks\n", received_samples, num_callbacks);
+  fprintf(stderr, "received=%llu IQ samples in %d callbacks\n", received_samples, num_callbacks);
   fprintf(stderr, "run for %f sec\n", dur);
   fprintf(stderr, "approx. samplerate is %f kSamples/sec\n", received_samples / (1000.0*dur) );
 
   if (outfilename && sampleData && received_samples) {
     FILE * f = fopen(outfilename, "wb");
     if (f) {
-      fprintf(stderr, "saving received real samples to file ..\n");
-      waveWriteHeader( (unsigned)(0.5 + sample_rate), 0U /*frequency*/, 16 /*bitsPerSample*/, 1 /*numChannels*/, f);
-      for ( unsigned long long off = 0; off + 65536 < received_samples; off += 65536 )
-        waveWriteSamples(f,  sampleData + off, 65536, 0 /*needCleanData*/);
+      /* 16 bit I/Q, the float samples scaled to the peak of the capture */
+      float peak = 0.0f;
+      for (unsigned long long i = 0; i < 2 * received_samples; i++) {
+        float v = sampleData[i] < 0.0f ? -sampleData[i] : sampleData[i];
+        if (v > peak)
+          peak = v;
+      }
+      const float scale = (peak > 0.0f) ? 32767.0f / peak : 0.0f;
+      static int16_t frames[2 * 65536];
+      fprintf(stderr, "saving received IQ samples to file, scaled by %g ..\n", scale);
+      waveWriteHeader( (unsigned)(0.5 + sample_rate), 0U /*frequency*/, 16 /*bitsPerSample*/, 2 /*numChannels*/, f);
+      for ( unsigned long long off = 0; off < received_samples; off += 65536 ) {
+        unsigned long long n = received_samples - off;
+        if (n > 65536)
+          n = 65536;
+        for (unsigned long long i = 0; i < 2 * n; i++) {
+          float v = sampleData[2 * off + i] * scale;
+          frames[i] = (int16_t)(v < 0.0f ? v - 0.5f : v + 0.5f);
+        }
+        waveWriteFrames(f, frames, n, 0 /*needCleanData*/);
+      }
       waveFinalizeHeader(f);
       fclose(f);
     }
@@ -225,10 +245,11 @@ static void count_bytes_callback(uint32_t data_size,
   if (stop_reception)
     return;
   ++num_callbacks;
-  unsigned N = data_size / sizeof(int16_t);
+  /* interleaved float I and Q */
+  unsigned N = data_size / (2 * sizeof(float));
   if ( received_samples + N < total_samples ) {
     if (sampleData)
-      memcpy( sampleData+received_samples, data, data_size);
+      memcpy( sampleData + 2 * received_samples, data, data_size);
     received_samples += N;
   }
   else {
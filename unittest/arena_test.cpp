@@ -0,0 +1,125 @@
+#include "buffer_arena.h"
+#include "dsp/ringbuffer.h"
+
+#include "CppUnitTestFramework.hpp"
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+namespace {
+    struct ArenaFixture {};
+
+    // with the sanitizer all blocks are plain allocations
+#if defined(__SANITIZE_ADDRESS__)
+    const bool arena = false;
+#else
+    const bool arena = true;
+#endif
+}
+
+TEST_CASE(ArenaFixture, AllocTest)
+{
+    // small blocks share chunks, large ones have their own; all aligned
+    // and apart
+    const auto before = bufferArena::getUsage();
+    const size_t sizes[] = { 1, 64, 100, 4096, 65536 + 8, 300000, 512 * 1024, 3 * 1024 * 1024 + 7 };
+    std::vector<uint8_t*> blocks;
+    for (int round = 0; round < 3; round++)
+    {
+        for (size_t size : sizes)
+        {
+            auto ptr = (uint8_t*)bufferArena::alloc(size);
+            REQUIRE_TRUE(ptr != nullptr);
+            CHECK_EQUAL((uintptr_t)ptr % bufferArena::ALIGNMENT, (uintptr_t)0);
+            memset(ptr, (int)blocks.size(), size);
+            blocks.push_back(ptr);
+        }
+    }
+    if (arena)
+        CHECK_EQUAL(bufferArena::getUsage().blocks, before.blocks + (int)blocks.size());
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const size_t size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        CHECK_TRUE(blocks[i][0] == (uint8_t)i && blocks[i][size - 1] == (uint8_t)i);
+        bufferArena::free(blocks[i]);
+    }
+    bufferArena::free(nullptr);
+
+    const auto after = bufferArena::getUsage();
+    CHECK_EQUAL(after.blocks, before.blocks);
+    // no more than the chunk in use stays mapped
+    CHECK_TRUE(after.mapped <= before.mapped + 2 * 1024 * 1024);
+}
+
+TEST_CASE(ArenaFixture, FlagsTest)
+{
+    const unsigned flags = bufferArena::getFlags();
+    const size_t hugePage = bufferArena::getHugePageSize();
+    const size_t size = 1024 * 1024 + 1;
+
+    // blocks below a huge page stay on normal pages
+    bufferArena::setFlags(bufferArena::HUGE_PAGES | bufferArena::PREFAULT);
+    auto before = bufferArena::getUsage();
+    auto ptr = bufferArena::alloc(size);
+    REQUIRE_TRUE(ptr != nullptr);
+    auto usage = bufferArena::getUsage();
+    if (arena && size < hugePage)
+    {
+        CHECK_EQUAL(usage.mapped - before.mapped, (size_t)1024 * 1024 + 4096);
+        CHECK_EQUAL(usage.huge, before.huge);
+    }
+    bufferArena::free(ptr);
+
+    // larger ones on huge pages, aligned to them, if the system has them
+    if (hugePage > 0)
+    {
+        before = bufferArena::getUsage();
+        ptr = bufferArena::alloc(2 * hugePage + 1);
+        REQUIRE_TRUE(ptr != nullptr);
+        usage = bufferArena::getUsage();
+        if (arena && usage.huge > before.huge)
+        {
+            CHECK_TRUE(usage.mapped - before.mapped >= 2 * hugePage + 1);
+            CHECK_EQUAL((uintptr_t)ptr % hugePage, (uintptr_t)0);
+        }
+        bufferArena::free(ptr);
+    }
+
+    // pages, locked if the limit allows it
+    bufferArena::setFlags(bufferArena::LOCK);
+    before = bufferArena::getUsage();
+    ptr = bufferArena::alloc(size);
+    REQUIRE_TRUE(ptr != nullptr);
+    usage = bufferArena::getUsage();
+    if (arena)
+    {
+        CHECK_EQUAL(usage.mapped - before.mapped, (size_t)1024 * 1024 + 4096);
+        CHECK_EQUAL(usage.huge, before.huge);
+        CHECK_TRUE(usage.locked == before.locked || usage.locked == before.locked + usage.mapped - before.mapped);
+    }
+    memset(ptr, 0x5a, size);
+    bufferArena::free(ptr);
+    CHECK_EQUAL(bufferArena::getUsage().mapped, before.mapped);
+
+    bufferArena::setFlags(flags);
+}
+
+TEST_CASE(ArenaFixture, RingbufferTest)
+{
+    // a ring's blocks are aligned, the ring gives them back when it goes
+    const auto before = bufferArena::getUsage();
+    {
+        ringbuffer<float> ring(8);
+        ring.setBlockSize(1000);
+        ring.setBlockSize(65536);
+        for (int i = 0; i < 8; i++)
+        {
+            CHECK_EQUAL((uintptr_t)ring.peekPtr(i) % ALIGN, (uintptr_t)0);
+            memset(ring.peekPtr(i), 0, sizeof(float) * 65536);
+        }
+        if (arena)
+            CHECK_EQUAL(bufferArena::getUsage().blocks, before.blocks + 1);
+    }
+    CHECK_EQUAL(bufferArena::getUsage().blocks, before.blocks);
+}
@@ -0,0 +1,98 @@
+#include "fft_backend.h"
+
+#include "CppUnitTestFramework.hpp"
+#include <vector>
+#include <complex>
+#include <math.h>
+
+namespace {
+    struct FftFixture {};
+
+    typedef std::complex<double> cd;
+
+    // direct DFT in double precision
+    std::vector<cd> Dft(const std::vector<cd>& x, bool forward)
+    {
+        const size_t n = x.size();
+        const double sign = forward ? -1.0 : 1.0;
+        std::vector<cd> result(n);
+        for (size_t k = 0; k < n; k++)
+        {
+            cd sum = 0.0;
+            for (size_t i = 0; i < n; i++)
+                sum += x[i] * std::polar(1.0, sign * 2.0 * 3.14159265358979323846 * (double)((k * i) % n) / n);
+            result[k] = sum;
+        }
+        return result;
+    }
+
+    std::vector<cd> Signal(size_t n, bool real)
+    {
+        std::vector<cd> x(n);
+        for (size_t i = 0; i < n; i++)
+            x[i] = cd(sin(0.37 * i) + 0.3 * cos(1.9 * i), real ? 0.0 : cos(0.11 * i * i));
+        return x;
+    }
+
+    // largest difference relative to the largest bin
+    double MaxError(const std::vector<cd>& ref, const fftComplex* out, size_t count)
+    {
+        double maxRef = 0.0, maxDiff = 0.0;
+        for (size_t k = 0; k < count; k++)
+        {
+            maxRef = std::max(maxRef, std::abs(ref[k]));
+            maxDiff = std::max(maxDiff, std::abs(ref[k] - cd(out[k][0], out[k][1])));
+        }
+        return maxDiff / maxRef;
+    }
+}
+
+TEST_CASE(FftFixture, BackendsTest)
+{
+    // every backend computes the DFT, for the sizes the r2iq uses
+    for (auto list = fftBackendList(); *list != nullptr; list++)
+    {
+        const fftBackend& backend = **list;
+        for (int n = 16; n <= 2048; n *= 2)
+        {
+            auto in = (fftComplex*)fftAlloc(sizeof(fftComplex) * n);
+            auto out = (fftComplex*)fftAlloc(sizeof(fftComplex) * (n + 1));
+
+            for (int forward = 0; forward < 2; forward++)
+            {
+                auto plan = backend.planC2c(n, in, out, forward != 0);
+                auto x = Signal(n, false);
+                for (int i = 0; i < n; i++)
+                {
+                    in[i][0] = (float)x[i].real();
+                    in[i][1] = (float)x[i].imag();
+                }
+                plan->execute(in, out);
+                CHECK_TRUE(MaxError(Dft(x, forward != 0), out, n) < 1e-5);
+                delete plan;
+            }
+
+            // pffft's smallest real transform is 32 samples
+            if (n >= 32)
+            {
+                auto plan = backend.planR2c(n, (float*)in, out);
+                auto x = Signal(n, true);
+                for (int i = 0; i < n; i++)
+                    ((float*)in)[i] = (float)x[i].real();
+                plan->execute((float*)in, out);
+                CHECK_TRUE(MaxError(Dft(x, true), out, n / 2 + 1) < 1e-5);
+                delete plan;
+            }
+
+            fftFree(in);
+            fftFree(out);
+        }
+    }
+}
+
+TEST_CASE(FftFixture, FindTest)
+{
+    CHECK_TRUE(fftBackendFind(nullptr) != nullptr);
+    CHECK_TRUE(fftBackendFind("pffft") == &fftBackend_pffft);
+    CHECK_TRUE(fftBackendFind("none") == nullptr);
+}
@@ -0,0 +1,178 @@
+#include "fft_mt_r2iq.h"
+#include "config.h"
+
+#include "CppUnitTestFramework.hpp"
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// every kernel table this cpu runs gives the output of the scalar
+// reference, through the whole worker loop built with it
+namespace {
+    struct IsaFixture {};
+
+    // deterministic ADC stream: tones and pseudo random noise at a level
+    // which uses most of the ADC range
+    void FillADC(int16_t* data, uint32_t count, uint64_t start)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t n = start + i;
+            float v = 9000.0f * sinf(0.3131f * (n % 7919)) + 5000.0f * cosf(2.0713f * (n % 4001));
+            v += (float)((int)((n * 2654435761u) >> 16 & 0xfff) - 2048);
+            data[i] = (int16_t)v;
+        }
+    }
+
+    struct Setup {
+        int decimate;
+        bool lsb;
+        float offset;
+        bool rand = false;
+        int interp = 1;
+        int decim = 1;
+        r2iqOutputFormat format = r2iqOutputFormat();
+    };
+
+    struct Output {
+        std::vector<float> iq;          // the output blocks as floats
+        std::vector<float> spectrum;    // the spectrum frames
+    };
+
+    const int spectrumBins = 256;
+
+    // the first 'blocks' output blocks of 'blockLen' samples of the main
+    // channel and the first spectrum frames, with the kernels 'name'
+    Output Run(const char* name, const Setup& setup, int blocks, int blockLen)
+    {
+        ringbuffer<int16_t> input;
+        ringbuffer<float> output;
+        ringbuffer<float> spectrum;
+        input.setBlockSize(transferSamples);
+        output.setBlockSize(blockLen * setup.format.sampleBytes());
+        spectrum.setBlockSize(spectrumBins);
+
+        fft_mt_r2iq r2iq;
+        REQUIRE_TRUE(r2iq.setKernels(name));
+        r2iq.setThreads(2);
+        r2iq.Init(1.0f, &input, &output);
+        r2iq.setDecimate(setup.decimate);
+        r2iq.setResample(setup.interp, setup.decim);
+        r2iq.setOutputFormat(setup.format);
+        r2iq.setSideband(setup.lsb);
+        r2iq.updateRand(setup.rand);
+        r2iq.setFreqOffset(setup.offset);
+        r2iq.setSpectrum(&spectrum, spectrumBins, 1);
+        r2iq.TurnOn();
+
+        bool run = true;
+        auto producer = std::thread([&input, &run]() {
+            uint64_t start = 0;
+            while (run)
+            {
+                auto ptr = input.getWritePtr();
+                if (!run)
+                    break;
+                FillADC(ptr, transferSamples, start);
+                start += transferSamples;
+                input.WriteDone();
+            }
+        });
+
+        Output out;
+        for (int i = 0; i < blocks; i++)
+        {
+            auto ptr = output.getReadPtr();
+            if (setup.format.format == FORMAT_CS16)
+                out.iq.insert(out.iq.end(), (const int16_t*)ptr, (const int16_t*)ptr + 2 * blockLen);
+            else
+                out.iq.insert(out.iq.end(), ptr, ptr + 2 * blockLen);
+            output.ReadDone();
+        }
+        // the spectrum ring holds the first frames, the rest are dropped
+        for (int i = 0; i < 3; i++)
+        {
+            auto ptr = spectrum.getReadPtr();
+            out.spectrum.insert(out.spectrum.end(), ptr, ptr + spectrumBins);
+            spectrum.ReadDone();
+        }
+
+        run = false;
+        r2iq.TurnOff();
+        producer.join();
+        return out;
+    }
+
+    // largest difference relative to the rms of the reference, without the
+    // undefined overlap of the first block
+    double Deviation(const std::vector<float>& ref, const std::vector<float>& out, size_t skip)
+    {
+        double sum = 0.0, diff = 0.0;
+        for (size_t i = skip; i < ref.size() && i < out.size(); i++)
+        {
+            sum += (double)ref[i] * ref[i];
+            diff = std::max(diff, fabs((double)ref[i] - out[i]));
+        }
+        return diff / sqrt(sum / (ref.size() - skip));
+    }
+
+    // each kernel table against the scalar one, after the first output block
+    // which has the overlap of the first input block
+    void Compare(const Setup& setup, int blocks, double tolerance, int blockLen = EXT_BLOCKLEN)
+    {
+        auto ref = Run("scalar", setup, blocks, blockLen);
+        for (auto list = r2iqKernelList(); *list != nullptr; list++)
+        {
+            if (*list == &r2iqKernels_ref)
+                continue;
+            auto out = Run((*list)->name, setup, blocks, blockLen);
+            REQUIRE_EQUAL(ref.iq.size(), out.iq.size());
+            const double deviation = Deviation(ref.iq, out.iq, 2 * blockLen);
+            if (deviation > tolerance)
+                printf("%s: deviation %g\n", (*list)->name, deviation);
+            CHECK_TRUE(deviation <= tolerance);
+            // the frames after the first one, which has the overlap
+            CHECK_TRUE(Deviation(ref.spectrum, out.spectrum, spectrumBins) <= 1e-5);
+        }
+    }
+}
+
+TEST_CASE(IsaFixture, FindTest)
+{
+    CHECK_TRUE(r2iqKernelFind("scalar") == &r2iqKernels_ref);
+    CHECK_TRUE(r2iqKernelFind("none") == nullptr);
+    for (auto list = r2iqKernelList(); *list != nullptr; list++)
+        CHECK_TRUE(r2iqKernelFind((*list)->name) != nullptr);
+
+    fft_mt_r2iq r2iq;
+    CHECK_TRUE(!r2iq.setKernels("none"));
+    REQUIRE_TRUE(r2iq.setKernels("scalar"));
+    CHECK_EQUAL(strcmp(r2iq.getKernels(), "scalar"), 0);
+}
+
+TEST_CASE(IsaFixture, DecimateTest)
+{
+    // the shift filters of both sidebands, with and without fine tuning,
+    // the ADC randomizer
+    Compare({ 0, false, 0.25f }, 2, 1e-5);
+    Setup setup = { 2, true, 0.3712f };
+    setup.rand = true;
+    Compare(setup, 2, 1e-5);
+}
+
+TEST_CASE(IsaFixture, StagesTest)
+{
+    // the half-band stages and the resampler of fir(), which fills ring
+    // blocks of any size
+    Compare({ NDECIDX, false, 0.1234f, false, 3, 5 }, 3, 1e-5, 2048);
+}
+
+TEST_CASE(IsaFixture, FormatTest)
+{
+    // the conversions of the last copy round alike, up to the last bit
+    Setup setup = { 1, false, 0.2101f };
+    setup.format.format = FORMAT_CS16;
+    Compare(setup, 2, 1e-3);
+}
@@ -0,0 +1,905 @@
+#include "fft_mt_r2iq.h"
+#include "fft_backend.h"
+#ifndef NO_FFTW
+#include "fftw_wisdom.h"
+#endif
+#include "config.h"
+
+#include "CppUnitTestFramework.hpp"
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <math.h>
+
+namespace {
+    struct R2iqFixture {};
+
+    // deterministic ADC stream: a few tones plus some pseudo random noise
+    void FillADC(int16_t* data, uint32_t count, uint64_t start)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t n = start + i;
+            float v = 3000.0f * sinf(0.7757f * (n % 8101)) + 1500.0f * cosf(2.5202f * (n % 5003));
+            v += (float)((int)((n * 2654435761u) >> 20 & 0xff) - 128);
+            data[i] = (int16_t)v;
+        }
+    }
+
+    // a single tone at 'toneFreq' cycles per ADC sample
+    double toneFreq = 0.135;
+    void FillTone(int16_t* data, uint32_t count, uint64_t start)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double phase = fmod(toneFreq * (double)(start + i), 1.0);
+            data[i] = (int16_t)(10000.0 * sin(2.0 * 3.14159265358979323846 * phase));
+        }
+    }
+
+    // the tone at 1.5 times full scale, clipped
+    void FillClipped(int16_t* data, uint32_t count, uint64_t start)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double phase = fmod(toneFreq * (double)(start + i), 1.0);
+            data[i] = (int16_t)std::min(std::max(49152.0 * sin(2.0 * 3.14159265358979323846 * phase), -32768.0), 32767.0);
+        }
+    }
+
+    typedef void (*FillFunc)(int16_t* data, uint32_t count, uint64_t start);
+    // changes while running, before the main channel's output block 'block' is read
+    typedef std::function<void(fft_mt_r2iq* r2iq, int block)> BlockFunc;
+
+    // fft backend of RunChannels(), nullptr for the default
+    const char* backendName = nullptr;
+
+    struct ChannelSetup {
+        int decimate;
+        bool lsb;
+        float offset;
+        int interp = 1;
+        int decim = 1;
+        r2iqOutputFormat format = r2iqOutputFormat();
+    };
+
+    // run the DDC over a generated ADC stream, return the first 'blocks' output blocks
+    // of the main channel and of each additional channel
+    std::vector<std::vector<float>> RunChannels(int threads, const ChannelSetup& main, const std::vector<ChannelSetup>& extra, int blocks,
+        int fftSize = FFTN_R_ADC, FillFunc fill = FillADC, adcStats* stats = nullptr,
+        BlockFunc beforeBlock = nullptr)
+    {
+        ringbuffer<int16_t> input;
+        ringbuffer<float> output[1 + 4];
+        input.setBlockSize(transferSamples);
+        output[0].setBlockSize(EXT_BLOCKLEN * main.format.sampleBytes());
+        for (size_t c = 0; c < extra.size(); c++)
+            output[1 + c].setBlockSize(EXT_BLOCKLEN * extra[c].format.sampleBytes());
+
+        auto r2iq = new fft_mt_r2iq();
+        r2iq->setThreads(threads);
+        r2iq->setFftSize(fftSize);
+        r2iq->setFftBackend(backendName);
+        r2iq->Init(1.0f, &input, &output[0]);
+        r2iq->setDecimate(main.decimate);
+        r2iq->setResample(main.interp, main.decim);
+        r2iq->setOutputFormat(main.format);
+        r2iq->setSideband(main.lsb);
+        r2iq->setFreqOffset(main.offset);
+        for (size_t c = 0; c < extra.size(); c++)
+        {
+            int channel = r2iq->addChannel(&output[1 + c], extra[c].decimate, extra[c].lsb, extra[c].interp, extra[c].decim, extra[c].format);
+            r2iq->setChannelFreqOffset(channel, extra[c].offset);
+        }
+        r2iq->TurnOn();
+
+        bool run = true;
+        auto producer = std::thread([&input, &run, fill]() {
+            uint64_t start = 0;
+            while (run)
+            {
+                auto ptr = input.getWritePtr();
+                if (!run)
+                    break;
+                fill(ptr, transferSamples, start);
+                start += transferSamples;
+                input.WriteDone();
+            }
+        });
+
+        // the rings hold enough blocks to read the channels one after the other
+        std::vector<std::vector<float>> result(1 + extra.size());
+        for (size_t c = 0; c < result.size(); c++)
+        {
+            for (int i = 0; i < blocks; i++)
+            {
+                if (c == 0 && beforeBlock)
+                    beforeBlock(r2iq, i);
+                auto ptr = output[c].getReadPtr();
+                result[c].insert(result[c].end(), ptr, ptr + output[c].getBlockSize() / sizeof(float));
+                output[c].ReadDone();
+            }
+        }
+
+        run = false;
+        r2iq->TurnOff();
+        producer.join();
+        if (stats != nullptr)
+            *stats = r2iq->getAdcStats();
+        delete r2iq;
+
+        return result;
+    }
+
+    std::vector<float> RunR2iq(int threads, int decimate, bool lsb, int blocks)
+    {
+        return RunChannels(threads, { decimate, lsb, 0.21f }, {}, blocks)[0];
+    }
+
+    double Rms(const std::vector<float>& out)
+    {
+        // without the first block
+        double sum = 0.0;
+        for (size_t i = EXT_BLOCKLEN * 2; i < out.size(); i++)
+            sum += (double)out[i] * out[i];
+        return sqrt(sum / (out.size() - EXT_BLOCKLEN * 2));
+    }
+
+    float HalfToFloat(uint16_t h)
+    {
+        const float mant = (float)(h & 0x3ff);
+        const int exp = (h >> 10) & 0x1f;
+        float v = (exp == 0) ? ldexpf(mant, -24) : ldexpf(mant + 1024.0f, exp - 25);
+        return (h & 0x8000) ? -v : v;
+    }
+
+    // the output blocks of RunChannels() in a format, as interleaved floats
+    std::vector<float> Samples(const std::vector<float>& raw, const r2iqOutputFormat& format)
+    {
+        const size_t blockLen = EXT_BLOCKLEN;
+        const size_t count = raw.size() * sizeof(float) / format.sampleBytes();
+        std::vector<float> out(2 * count);
+        auto bytes = (const uint8_t*)raw.data();
+        for (size_t i = 0; i < count; i++)
+        {
+            auto block = bytes + (i / blockLen) * blockLen * format.sampleBytes();
+            const size_t n = i % blockLen;
+            for (int q = 0; q < 2; q++)
+            {
+                const size_t index = format.planar ? q * blockLen + n : 2 * n + q;
+                float v = 0.0f;
+                switch (format.format)
+                {
+                case FORMAT_CF32: v = ((const float*)block)[index]; break;
+                case FORMAT_CS16: v = ((const int16_t*)block)[index]; break;
+                case FORMAT_CS8: v = ((const int8_t*)block)[index]; break;
+                default: v = HalfToFloat(((const uint16_t*)block)[index]); break;
+                }
+                out[2 * i + q] = v;
+            }
+        }
+        return out;
+    }
+
+    size_t Mismatches(const std::vector<float>& ref, const std::vector<float>& out)
+    {
+        // the first block carries an undefined overlap
+        size_t mismatch = 0;
+        for (size_t i = EXT_BLOCKLEN * 2; i < ref.size() && i < out.size(); i++)
+        {
+            if (ref[i] != out[i])
+                mismatch++;
+        }
+        return mismatch;
+    }
+}
+
+TEST_CASE(R2iqFixture, ThreadsTest)
+{
+    for (int decimate = 0; decimate < 3; decimate++)
+    {
+        auto ref = RunR2iq(1, decimate, false, 4);
+        auto out = RunR2iq(4, decimate, false, 4);
+
+        REQUIRE_EQUAL(ref.size(), out.size());
+        // blocks are processed independently, so any thread count gives the same result
+        CHECK_EQUAL(Mismatches(ref, out), (size_t)0);
+    }
+}
+
+TEST_CASE(R2iqFixture, ChannelsTest)
+{
+    // every channel gives the same output as a main channel set up alike
+    const ChannelSetup main = { 1, false, 0.21f };
+    const std::vector<ChannelSetup> extra = {
+        { 1, false, 0.21f },
+        { 0, true, 0.4f },
+        { 2, false, 0.1f },
+    };
+    auto out = RunChannels(2, main, extra, 4);
+    REQUIRE_EQUAL(out.size(), extra.size() + 1);
+
+    // the blocks use the segments of the highest decimation, a channel
+    // with it makes the references use them too
+    const std::vector<ChannelSetup> layout = { extra[2] };
+    auto ref = RunChannels(1, main, layout, 4)[0];
+    CHECK_EQUAL(Mismatches(ref, out[0]), (size_t)0);
+    for (size_t c = 0; c < extra.size(); c++)
+    {
+        ref = RunChannels(1, extra[c], layout, 4)[0];
+        REQUIRE_EQUAL(ref.size(), out[c + 1].size());
+        CHECK_EQUAL(Mismatches(ref, out[c + 1]), (size_t)0);
+    }
+}
+
+TEST_CASE(R2iqFixture, KernelsTest)
+{
+    // every kernel table this cpu runs matches the scalar reference,
+    // also for odd sizes and offsets which end in the scalar tails
+    const int size = 1003;
+    std::vector<int16_t> adc(size);
+    FillADC(adc.data(), size, 12345);
+    std::vector<float> a(2 * size), b(2 * size);
+    for (int i = 0; i < 2 * size; i++)
+    {
+        a[i] = sinf(0.1f * i) * 100.0f;
+        b[i] = cosf(0.37f * i);
+    }
+    auto ca = (fftComplex*)a.data();
+    auto cb = (fftComplex*)b.data();
+
+    const r2iqKernels& ref = r2iqKernels_ref;
+    std::vector<float> expect(2 * size), result(2 * size);
+    auto ce = (fftComplex*)expect.data();
+    auto cr = (fftComplex*)result.data();
+
+    for (auto list = r2iqKernelList(); *list != nullptr; list++)
+    {
+        const r2iqKernels& k = **list;
+        for (int rand = 0; rand < 2; rand++)
+        {
+            ref.convert_float[rand](adc.data() + 1, expect.data(), size - 1);
+            k.convert_float[rand](adc.data() + 1, result.data(), size - 1);
+            CHECK_EQUAL(memcmp(expect.data(), result.data(), sizeof(float) * (size - 1)), 0);
+        }
+
+        for (int conj = 0; conj < 2; conj++)
+        {
+            // the compiler may fuse multiply-adds differently
+            ref.shift_freq[conj](ce, ca + 1, cb, 3, size - 1);
+            k.shift_freq[conj](cr, ca + 1, cb, 3, size - 1);
+            float maxdiff = 0.0f;
+            for (int i = 2 * 3; i < 2 * (size - 1); i++)
+                maxdiff = std::max(maxdiff, fabsf(expect[i] - result[i]));
+            CHECK_TRUE(maxdiff <= 1e-4f);
+        }
+
+        for (int flip = 0; flip < 2; flip++)
+        {
+            ref.copy[flip](ce + 1, ca, size - 1);
+            k.copy[flip](cr + 1, ca, size - 1);
+            CHECK_EQUAL(memcmp(ce + 1, cr + 1, sizeof(fftComplex) * (size - 1)), 0);
+        }
+
+        // the conversions round and saturate alike
+        for (int format = 0; format < NFORMAT; format++)
+        {
+            for (int planar = 0; planar < 2; planar++)
+            {
+                std::vector<uint8_t> e(8 * size), r(8 * size);
+                ref.store[format][planar](e.data(), size, 1, ca + 2, size - 3, 400.0f);
+                k.store[format][planar](r.data(), size, 1, ca + 2, size - 3, 400.0f);
+                CHECK_EQUAL(memcmp(e.data(), r.data(), e.size()), 0);
+            }
+        }
+
+        // the statistics count alike, here with both clipping codes
+        for (int rand = 0; rand < 2; rand++)
+        {
+            std::vector<int16_t> clipped(adc);
+            clipped[7] = INT16_MIN;
+            clipped[300] = INT16_MAX;
+            clipped[301] = (int16_t)(INT16_MIN | rand);
+            adcStats e, r;
+            ref.convert_stats[rand](clipped.data() + 1, expect.data(), size - 1, &e);
+            k.convert_stats[rand](clipped.data() + 1, result.data(), size - 1, &r);
+            CHECK_EQUAL(memcmp(expect.data(), result.data(), sizeof(float) * (size - 1)), 0);
+            CHECK_EQUAL(r.samples, (uint64_t)(size - 1));
+            CHECK_EQUAL(r.clipped, e.clipped);
+            CHECK_EQUAL(r.min, e.min);
+            CHECK_EQUAL(r.max, e.max);
+            for (int n = 0; n < ADC_LEVELS; n++)
+                CHECK_EQUAL(r.levels[n], e.levels[n]);
+        }
+
+        // the vectors add up per lane
+        for (int taps : { 1, 7, 64, 501 })
+        {
+            ref.fir(ca + 1, b.data(), taps, ce);
+            k.fir(ca + 1, b.data(), taps, cr);
+            CHECK_TRUE(fabsf(ce[0][0] - cr[0][0]) <= 1e-3f);
+            CHECK_TRUE(fabsf(ce[0][1] - cr[0][1]) <= 1e-3f);
+        }
+        // and so do the half-band stage's, with the center added
+        ref.halfband(ca + 1, ca + 40, b.data(), 38, ce, 64);
+        k.halfband(ca + 1, ca + 40, b.data(), 38, cr, 64);
+        for (int m = 0; m < 64; m++)
+        {
+            CHECK_TRUE(fabsf(ce[m][0] - cr[m][0]) <= 1e-3f);
+            CHECK_TRUE(fabsf(ce[m][1] - cr[m][1]) <= 1e-3f);
+        }
+
+        // the spectrum adds to what is there
+        std::fill(expect.begin(), expect.end(), 1.0f);
+        std::fill(result.begin(), result.end(), 1.0f);
+        ref.power(ca + 1, size - 2, expect.data());
+        k.power(ca + 1, size - 2, result.data());
+        float maxdiff = 0.0f;
+        for (int i = 0; i < size; i++)
+            maxdiff = std::max(maxdiff, fabsf(expect[i] - result[i]) / expect[i]);
+        CHECK_TRUE(maxdiff <= 1e-5f);
+    }
+}
+
+TEST_CASE(R2iqFixture, AdcStatsTest)
+{
+    // the workers count each sample of the stream once, from the first one
+    // on, into every level, whatever the segment layout
+    toneFreq = 0.0123;
+    for (int decimate : { 0, NDECIDX - 1 })
+    {
+        adcStats stats;
+        RunChannels(3, { decimate, false, 0.25f }, {}, 4, FFTN_R_ADC, FillClipped, &stats);
+        REQUIRE_TRUE(stats.samples >= 3 * transferSamples);
+
+        std::vector<int16_t> adc(stats.samples);
+        std::vector<float> converted(stats.samples);
+        FillClipped(adc.data(), (uint32_t)adc.size(), 0);
+        adcStats expect;
+        r2iqKernels_ref.convert_stats[0](adc.data(), converted.data(), (int)adc.size(), &expect);
+        CHECK_EQUAL(stats.clipped, expect.clipped);
+        CHECK_TRUE(stats.clipped > 0);
+        CHECK_EQUAL(stats.min, (int16_t)INT16_MIN);
+        CHECK_EQUAL(stats.max, (int16_t)INT16_MAX);
+        for (int n = 0; n < ADC_LEVELS; n++)
+        {
+            CHECK_EQUAL(stats.levels[n], expect.levels[n]);
+            CHECK_TRUE(stats.levels[n] > 0);
+        }
+    }
+}
+
+TEST_CASE(R2iqFixture, SpectrumTest)
+{
+    // the tone adds up to its power relative to full scale in its bin, the
+    // others stay below the window's sidelobes
+    toneFreq = 0.135;
+    const int bins = 1024;
+    ringbuffer<int16_t> input;
+    ringbuffer<float> output;
+    ringbuffer<float> spectrum(4);
+    input.setBlockSize(transferSamples);
+    output.setBlockSize(EXT_BLOCKLEN * 2);
+    spectrum.setBlockSize(bins);
+
+    fft_mt_r2iq r2iq;
+    r2iq.setThreads(2);
+    r2iq.Init(1.0f, &input, &output);
+    r2iq.setDecimate(2);
+    CHECK_TRUE(!r2iq.setSpectrum(&spectrum, 1000, 1));
+    REQUIRE_TRUE(r2iq.setSpectrum(&spectrum, bins, 2));
+    r2iq.TurnOn();
+
+    bool run = true;
+    auto producer = std::thread([&input, &run]() {
+        uint64_t start = 0;
+        while (run)
+        {
+            auto ptr = input.getWritePtr();
+            if (!run)
+                break;
+            FillTone(ptr, transferSamples, start);
+            start += transferSamples;
+            input.WriteDone();
+        }
+    });
+
+    // the first frame has the undefined overlap of block 0
+    spectrum.getReadPtr();
+    spectrum.ReadDone();
+    const int peak = (int)(toneFreq * 2 * bins);
+    const double expect = (10000.0 / 32768.0) * (10000.0 / 32768.0);
+    for (int frame = 1; frame < 3; frame++)
+    {
+        const float* p = spectrum.getReadPtr();
+        const double tone = (double)p[peak - 1] + p[peak] + p[peak + 1];
+        CHECK_TRUE(fabs(tone / expect - 1.0) < 0.01);
+        float others = 0.0f;
+        for (int b = 0; b < bins; b++)
+        {
+            if (abs(b - peak) > 4)
+                others = std::max(others, p[b]);
+        }
+        CHECK_TRUE(others < 1e-6f * expect);
+        spectrum.ReadDone();
+    }
+
+    // nobody reads the spectrum, the DDC drops its frames and goes on
+    for (int i = 0; i < 16; i++)
+    {
+        output.getReadPtr();
+        output.ReadDone();
+    }
+    CHECK_TRUE(spectrum.isFull());
+
+    run = false;
+    r2iq.TurnOff();
+    producer.join();
+}
+
+TEST_CASE(R2iqFixture, ReconfigureTest)
+{
+    // the output continues with the new settings from an input block on,
+    // as if they had been there from the start
+    const ChannelSetup cases[][2] = {
+        { { 2, false, 0.25f }, { 1, false, 0.25f } },
+        { { 1, false, 0.25f }, { 2, true, 0.25f } },            // at a ring block boundary
+        { { 2, false, 0.25f, 3, 5 }, { 3, false, 0.25f } },     // filled at commit from then on
+    };
+    // the workers run ahead up to a full ring
+    const int blocks = 64 + 16;
+    for (const auto& c : cases)
+    {
+        const auto& from = c[0];
+        const auto& to = c[1];
+        auto out = RunChannels(3, from, {}, blocks, FFTN_R_ADC, FillADC, nullptr, [&to](fft_mt_r2iq* r2iq, int block) {
+            if (block == 2)
+                r2iq->reconfigure(to.decimate, to.lsb, to.interp, to.decim);
+        })[0];
+        auto before = RunChannels(1, from, {}, blocks)[0];
+        const int inputBlocks = (blocks << std::max(from.decimate, to.decimate)) * from.decim / from.interp + 1;
+        auto after = RunChannels(1, to, {}, (inputBlocks >> to.decimate) + 2)[0];
+
+        // the first sample of the new settings
+        size_t p = EXT_BLOCKLEN * 2;
+        while (p < out.size() && out[p] == before[p])
+            p++;
+        p -= p % 2;
+        REQUIRE_TRUE(p < out.size());
+        CHECK_TRUE(p > EXT_BLOCKLEN * 2);
+
+        // which is the first one of an input block there
+        const size_t perBlock = 2 * (transferSamples >> (to.decimate + 1));
+        bool found = false;
+        for (size_t start = perBlock; start + out.size() - p <= after.size() && !found; start += perBlock)
+        {
+            found = std::equal(out.begin() + p, out.end(), after.begin() + start);
+        }
+        CHECK_TRUE(found);
+    }
+}
+
+TEST_CASE(R2iqFixture, RetuneTest)
+{
+    // a tone keeps its phase across the segments and blocks, also when it
+    // is retuned while running in steps of the whole bins and the fine
+    // tuning: from one output sample to the next it advances by what one
+    // of the offsets gives, without steps in between
+    toneFreq = 0.1301;
+    const float offsets[] = { 0.2521f, 0.2510f, 0.2496f, 0.2503f, 0.2507f };
+    for (int lsb = 0; lsb < 2; lsb++)
+    {
+        for (int retune = 0; retune < 2; retune++)
+        {
+            const ChannelSetup tone = { 2, lsb != 0, offsets[0] };
+            auto out = RunChannels(3, tone, {}, 80, FFTN_R_ADC, FillTone, nullptr, [&](fft_mt_r2iq* r2iq, int block) {
+                if (retune)
+                    r2iq->setFreqOffset(offsets[block % 5]);
+            })[0];
+
+            const double pi = 3.14159265358979323846;
+            size_t steps = 0;
+            for (size_t i = EXT_BLOCKLEN * 2; i + 3 < out.size(); i += 2)
+            {
+                // phase advance of the tone, against the closest expected one
+                const double advance = atan2(out[i + 3] * out[i] - out[i + 2] * out[i + 1], out[i + 2] * out[i] + out[i + 3] * out[i + 1]);
+                double diff = pi;
+                for (int o = 0; o < (retune ? 5 : 1); o++)
+                {
+                    double expect = 2.0 * pi * (toneFreq - offsets[o] / 2.0) * 8.0;
+                    if (tone.lsb)
+                        expect = -expect;
+                    diff = std::min(diff, fabs(remainder(advance - expect, 2.0 * pi)));
+                }
+                if (diff > 1e-3)
+                    steps++;
+            }
+            CHECK_EQUAL(steps, (size_t)0);
+        }
+    }
+}
+
+TEST_CASE(R2iqFixture, TuneWhileFullTest)
+{
+    // nobody reads the output, the dispatcher waits for a ring block:
+    // retuning does not wait with it
+    ringbuffer<int16_t> input;
+    ringbuffer<float> output;
+    input.setBlockSize(transferSamples);
+    output.setBlockSize(EXT_BLOCKLEN * 2);
+
+    fft_mt_r2iq r2iq;
+    r2iq.setThreads(2);
+    r2iq.Init(1.0f, &input, &output);
+    r2iq.setDecimate(2);
+    r2iq.TurnOn();
+
+    bool run = true;
+    auto producer = std::thread([&input, &run]() {
+        uint64_t start = 0;
+        while (run)
+        {
+            auto ptr = input.getWritePtr();
+            if (!run)
+                break;
+            FillADC(ptr, transferSamples, start);
+            start += transferSamples;
+            input.WriteDone();
+        }
+    });
+
+    for (int i = 0; i < 1000 && !output.isFull(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    REQUIRE_TRUE(output.isFull());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::atomic<bool> done(false);
+    auto tuner = std::thread([&r2iq, &done]() {
+        r2iq.setFreqOffset(0.2f);
+        r2iq.setChannelFreqOffset(0, 0.3f);
+        done = true;
+    });
+    for (int i = 0; i < 200 && !done; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK_TRUE(done);
+
+    // stopping the rings releases a dispatcher still waiting
+    run = false;
+    r2iq.TurnOff();
+    tuner.join();
+    producer.join();
+}
+
+TEST_CASE(R2iqFixture, FftSizeTest)
+{
+    // each fft size gives a clean tone of the same level, without steps at
+    // the segment boundaries (within the passband ripple of the short
+    // filters), and the same result with any thread count
+    const ChannelSetup tone = { 2, false, 0.25f };   // fs/8 +- fs/16
+    toneFreq = 0.135;
+    float level = 0.0f;
+    for (int size = FFTN_R_ADC_MIN; size <= FFTN_R_ADC_MAX; size *= 2)
+    {
+        auto out = RunChannels(1, tone, {}, 4, size, FillTone)[0];
+        float minMag = 1e30f, maxMag = 0.0f;
+        for (size_t i = EXT_BLOCKLEN * 2; i < out.size(); i += 2)
+        {
+            float mag = sqrtf(out[i] * out[i] + out[i + 1] * out[i + 1]);
+            minMag = std::min(minMag, mag);
+            maxMag = std::max(maxMag, mag);
+        }
+        if (level == 0.0f)
+            level = maxMag;
+        CHECK_TRUE(minMag > 0.99f * level && maxMag < 1.01f * level);
+
+        auto ref = RunChannels(1, tone, {}, 4, size)[0];
+        auto mt = RunChannels(3, tone, {}, 4, size)[0];
+        REQUIRE_EQUAL(ref.size(), mt.size());
+        CHECK_EQUAL(Mismatches(ref, mt), (size_t)0);
+    }
+
+    fft_mt_r2iq r2iq;
+    CHECK_TRUE(!r2iq.setFftSize(FFTN_R_ADC_MIN / 2));
+    CHECK_TRUE(!r2iq.setFftSize(3 * FFTN_R_ADC_MIN));
+    CHECK_TRUE(!r2iq.setFftSize(2 * FFTN_R_ADC_MAX));
+}
+
+TEST_CASE(R2iqFixture, FilterTest)
+{
+    // the filter length follows the decimation: a tone just outside the
+    // output band is attenuated as much for the narrow outputs
+    for (int decimate = 1; decimate < 5; decimate++)
+    {
+        const ChannelSetup band = { decimate, false, 0.25f };  // fs/8
+        const double nyquist = 0.25 / (1 << decimate);        // of the output, in ADC cycles per sample
+        toneFreq = 0.125 + 0.5 * nyquist;
+        double pass = Rms(RunChannels(1, band, {}, 3, FFTN_R_ADC, FillTone)[0]);
+        toneFreq = 0.125 + 1.1 * nyquist;
+        double stop = Rms(RunChannels(1, band, {}, 3, FFTN_R_ADC, FillTone)[0]);
+        CHECK_TRUE(20.0 * log10(stop / pass) < -85.0);   // the int16_t tone limits it
+    }
+}
+
+TEST_CASE(R2iqFixture, HalfbandTest)
+{
+    // the half-band stages pass the band of the final output with unity
+    // gain and remove what would alias into it
+    const int stages = NHALFBAND;
+    const int count = 4096;
+    auto run = [](double freq) {
+        halfbandCascade cascade;
+        cascade.init(stages, count);
+        std::vector<float> in(2 * count), out(2 * count);
+        double sum = 0.0;
+        for (int block = 0; block < 4; block++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                double phase = 2.0 * 3.14159265358979323846 * freq * (block * count + i);
+                in[2 * i] = (float)cos(phase);
+                in[2 * i + 1] = (float)sin(phase);
+            }
+            int n = cascade.process((fftComplex*)in.data(), count, (fftComplex*)out.data(), r2iqKernels_ref.halfband);
+            REQUIRE_EQUAL(n, count >> stages);
+            if (block == 0)
+                continue;   // the filters fill up
+            for (int i = 0; i < 2 * n; i++)
+                sum += (double)out[i] * out[i];
+        }
+        return sqrt(sum / (3 * (count >> stages)));
+    };
+
+    // in cycles per input sample, the output Nyquist is 0.5 / 2^stages
+    const double nyquist = 0.5 / (1 << stages);
+    for (double f : { 0.0, 0.5 * nyquist, -0.85 * nyquist })
+        CHECK_TRUE(fabs(run(f) - 1.0) < 1e-3);
+    for (double f : { 1.15 * nyquist, -1.5 * nyquist, 3.0 * nyquist, 0.3 })
+        CHECK_TRUE(20.0 * log10(run(f)) < -100.0);
+}
+
+TEST_CASE(R2iqFixture, CascadeTest)
+{
+    // the lowest output rate, after the half-band stages, keeps the level
+    // of the fft decimation and its attenuation outside the band. The
+    // half-band filters are down from 1.15 * Nyquist on, less folds into
+    // the band above relPass only
+    const int decimate = NDECIMATE - 1;
+    const ChannelSetup band = { decimate, false, 0.25f };  // fs/8
+    const double nyquist = 0.25 / (1 << decimate);
+    toneFreq = 0.125 + 0.5 * nyquist;
+    double pass = Rms(RunChannels(2, band, {}, 2, FFTN_R_ADC, FillTone)[0]);
+    double ref = Rms(RunChannels(2, { NDECIDX - 1, false, 0.25f }, {}, 2, FFTN_R_ADC, FillTone)[0]);
+    CHECK_TRUE(fabs(pass / ref - 1.0) < 0.01);
+    toneFreq = 0.125 + 1.2 * nyquist;
+    double stop = Rms(RunChannels(2, band, {}, 2, FFTN_R_ADC, FillTone)[0]);
+    CHECK_TRUE(20.0 * log10(stop / pass) < -85.0);
+}
+
+TEST_CASE(R2iqFixture, ResamplerTest)
+{
+    // the filter bank passes the band of the output rate with unity gain
+    // and removes what would alias into it, for any ratio
+    const int count = 4096;
+    auto run = [](int interp, int decim, double freq) {
+        rationalResampler resampler;
+        resampler.init(interp, decim);
+        std::vector<float> in(2 * count);
+        double sum = 0.0;
+        int total = 0, measured = 0;
+        for (int block = 0; block < 4; block++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                double phase = 2.0 * 3.14159265358979323846 * freq * (block * count + i);
+                in[2 * i] = (float)cos(phase);
+                in[2 * i + 1] = (float)sin(phase);
+            }
+            auto data = (fftComplex*)in.data();
+            int n = resampler.process(data, count, data, r2iqKernels_ref.fir);
+            total += n;
+            if (block == 0)
+                continue;   // the filter fills up
+            for (int i = 0; i < 2 * n; i++)
+                sum += (double)in[i] * in[i];
+            measured += n;
+        }
+        // the output keeps pace with the input
+        CHECK_TRUE(abs(total - 4 * count * interp / decim) <= 1);
+        return sqrt(sum / measured);
+    };
+
+    for (auto ratio : { std::make_pair(3, 5), std::make_pair(25, 32) })
+    {
+        // in cycles per input sample
+        const double nyquist = 0.5 * ratio.first / ratio.second;
+        for (double f : { 0.0, 0.5 * nyquist, -0.85 * nyquist })
+            CHECK_TRUE(fabs(run(ratio.first, ratio.second, f) - 1.0) < 1e-3);
+        for (double f : { 1.2 * nyquist, -1.25 * nyquist })
+            CHECK_TRUE(20.0 * log10(run(ratio.first, ratio.second, f)) < -100.0);
+    }
+
+    int interp, decim;
+    CHECK_TRUE(rationalResampler::approximate(2.4 / 4.0, interp, decim) == 0.6);
+    CHECK_EQUAL(interp, 3);
+    CHECK_EQUAL(decim, 5);
+    CHECK_TRUE(fabs(rationalResampler::approximate(0.7071, interp, decim) - 0.7071) < 1e-4);
+    CHECK_TRUE(interp <= RESAMPLE_MAX_INTERP);
+}
+
+TEST_CASE(R2iqFixture, ResampleTest)
+{
+    // a resampled channel keeps the level of its decimation and the
+    // frequency of the tone, and the attenuation outside the lower rate
+    const int decimate = 3;
+    const ChannelSetup band = { decimate, false, 0.25f, 3, 5 };
+    const double nyquist = 0.25 / (1 << decimate) * 3 / 5;
+    toneFreq = 0.125 + 0.3 * nyquist;
+    auto out = RunChannels(2, band, {}, 3, FFTN_R_ADC, FillTone)[0];
+    double pass = Rms(out);
+    double ref = Rms(RunChannels(2, { decimate, false, 0.25f }, {}, 3, FFTN_R_ADC, FillTone)[0]);
+    CHECK_TRUE(fabs(pass / ref - 1.0) < 0.01);
+
+    // 0.15 of the output rate, also from one ring block to the next
+    double maxDiff = 0.0;
+    for (size_t i = EXT_BLOCKLEN * 2; i + 3 < out.size(); i += 2)
+    {
+        double re = out[i + 2] * out[i] + out[i + 3] * out[i + 1];
+        double im = out[i + 3] * out[i] - out[i + 2] * out[i + 1];
+        maxDiff = std::max(maxDiff, fabs(atan2(im, re) - 0.3 * 3.14159265358979323846));
+    }
+    CHECK_TRUE(maxDiff < 1e-2);
+
+    toneFreq = 0.125 + 1.2 * nyquist;
+    double stop = Rms(RunChannels(2, band, {}, 3, FFTN_R_ADC, FillTone)[0]);
+    CHECK_TRUE(20.0 * log10(stop / pass) < -85.0);
+}
+
+TEST_CASE(R2iqFixture, FormatTest)
+{
+    // every format carries the float samples with its scale, rounded, in
+    // the decimated and in the resampled output
+    r2iqOutputFormat cs16, cs8, cf16, planar;
+    cs16.format = FORMAT_CS16;
+    cs16.scale = 1.0f / 1024.0f;
+    cs8.format = FORMAT_CS8;
+    cs8.planar = true;
+    cs8.scale = 1.0f / 1024.0f / 256.0f;
+    cf16.format = FORMAT_CF16;
+    planar.planar = true;
+    const float limit[] = { 0.0f, 0.5f, 0.5f, 1.0f };    // in units of the format, half ulps for cf16
+
+    for (int resample = 0; resample < 2; resample++)
+    {
+        ChannelSetup setup = { 2, false, 0.3f };
+        if (resample)
+        {
+            setup.interp = 3;
+            setup.decim = 5;
+        }
+        std::vector<ChannelSetup> extra(4, setup);
+        extra[0].format = cs16;
+        extra[1].format = cs8;
+        extra[2].format = cf16;
+        extra[3].format = planar;
+        auto out = RunChannels(2, setup, extra, 3);
+
+        const auto& ref = out[0];
+        for (size_t c = 0; c < extra.size(); c++)
+        {
+            const auto& format = extra[c].format;
+            auto samples = Samples(out[1 + c], format);
+            REQUIRE_EQUAL(samples.size(), ref.size());
+            // cf16 defaults to 1.0 for a full scale ADC tone
+            const float scale = (format.format == FORMAT_CF16) ? 1.0f / (32768.0f * 1024.0f) : (format.scale == 0.0f) ? 1.0f : format.scale;
+            double maxDiff = 0.0;
+            for (size_t i = EXT_BLOCKLEN * 2; i < ref.size(); i++)
+            {
+                float expect = ref[i] * scale;
+                double diff = fabs(samples[i] - expect);
+                if (format.format == FORMAT_CF16)
+                    diff /= ldexpf(std::max(fabsf(expect), ldexpf(1.0f, -14)), -11);    // half an ulp
+                maxDiff = std::max(maxDiff, diff);
+            }
+            CHECK_TRUE(maxDiff <= limit[format.format] * 1.001);
+        }
+    }
+
+    // the default of cs16: a full scale ADC tone is full scale
+    toneFreq = 0.125 + 0.01;
+    r2iqOutputFormat fullScale;
+    fullScale.format = FORMAT_CS16;
+    ChannelSetup band = { 3, false, 0.25f };
+    band.format = fullScale;
+    auto tone = Samples(RunChannels(2, band, {}, 3, FFTN_R_ADC, FillTone)[0], fullScale);
+    double sum = 0.0;
+    for (size_t i = EXT_BLOCKLEN * 2; i < tone.size(); i += 2)
+        sum += hypot(tone[i], tone[i + 1]);
+    CHECK_TRUE(fabs(sum / (tone.size() / 2 - EXT_BLOCKLEN) / (10000.0 * 32767.0 / 32768.0) - 1.0) < 0.01);
+}
+
+TEST_CASE(R2iqFixture, BackendTest)
+{
+    // every fft backend gives the same output, within float rounding
+    const ChannelSetup setups[] = { { 0, false, 0.21f }, { 3, true, 0.3f } };
+    for (const auto& setup : setups)
+    {
+        backendName = "pffft";
+        auto ref = RunChannels(2, setup, {}, 3)[0];
+        const double rms = Rms(ref);
+        for (auto list = fftBackendList(); *list != nullptr; list++)
+        {
+            backendName = (*list)->name();
+            auto out = RunChannels(2, setup, {}, 3)[0];
+            REQUIRE_EQUAL(ref.size(), out.size());
+            double maxDiff = 0.0;
+            for (size_t i = EXT_BLOCKLEN * 2; i < out.size(); i++)
+                maxDiff = std::max(maxDiff, (double)fabsf(out[i] - ref[i]));
+            CHECK_TRUE(maxDiff < 1e-4 * rms);
+        }
+        backendName = nullptr;
+    }
+}
+
+#ifndef NO_FFTW
+TEST_CASE(R2iqFixture, WisdomTest)
+{
+    // Init plans into the cache once, then finds its wisdom there
+    const auto dir = std::filesystem::temp_directory_path() / "sddc_wisdom_test";
+    std::filesystem::remove_all(dir);
+    fftwWisdom::setDir(dir.string().c_str());
+
+    const int size = FFTN_R_ADC_MIN;
+    const auto file = fftwWisdom::fileName(size);
+    CHECK_TRUE(file.find(fftwWisdom::cpuName()) != std::string::npos);
+    CHECK_TRUE(!fftwWisdom::load(size));
+
+    ringbuffer<int16_t> input;
+    ringbuffer<float> output;
+    input.setBlockSize(transferSamples);
+    output.setBlockSize(EXT_BLOCKLEN * 2 * sizeof(float));
+    {
+        fft_mt_r2iq r2iq;
+        r2iq.setFftSize(size);
+        r2iq.setFftBackend("fftw");
+        r2iq.Init(1.0f, &input, &output);
+    }
+    CHECK_TRUE(std::filesystem::exists(file));
+    CHECK_TRUE(fftwWisdom::load(size));
+
+    // a cached file without the plans: measured and saved with them
+    const auto full = std::filesystem::file_size(file);
+    fftwf_forget_wisdom();
+    CHECK_TRUE(fftwWisdom::save(size));
+    const auto empty = std::filesystem::file_size(file);
+    CHECK_TRUE(empty < full);
+    {
+        fft_mt_r2iq r2iq;
+        r2iq.setFftSize(size);
+        r2iq.setFftBackend("fftw");
+        r2iq.Init(1.0f, &input, &output);
+    }
+    const auto measured = std::filesystem::file_size(file);
+    CHECK_TRUE(measured > empty);
+
+    // another size has a file of its own, the first size's one stays
+    {
+        fft_mt_r2iq r2iq;
+        r2iq.setFftSize(2 * size);
+        r2iq.setFftBackend("fftw");
+        r2iq.Init(1.0f, &input, &output);
+    }
+    CHECK_TRUE(std::filesystem::exists(fftwWisdom::fileName(2 * size)));
+    CHECK_TRUE(std::filesystem::file_size(file) == measured);
+    CHECK_TRUE(fftwWisdom::remove(2 * size));
+
+    CHECK_TRUE(fftwWisdom::remove(size));
+    CHECK_TRUE(!std::filesystem::exists(file));
+
+    fftwWisdom::setDir(nullptr);
+    std::filesystem::remove_all(dir);
+}
+#endif
@@ -22,7 +22,7 @@ TEST_CASE(RingBufferFixture, BasicTest)
     auto ptr2 = ringbuf->getReadPtr();
     REQUIRE_EQUAL(*ptr2, 0x5a5a);
     REQUIRE_EQUAL(*(ptr2 + 0x100), 0x5a5a);
-    delete ptr;
+    delete ringbuf;
 }
 
 TEST_CASE(RingBufferFixture, TwoThreadsTest)
@@ -174,4 +174,61 @@ TEST_CASE(RingBufferFixture, PeekTest)
 
     auto rptr2 = buffer.peekReadPtr(-1);
     CHECK_EQUAL(rptr0, rptr2);
-}
\ No newline at end of file
+}
+
+TEST_CASE(RingBufferFixture, OrderTest)
+{
+    // every block arrives once and in order, its data with it, through
+    // a ring which wraps around all the time
+    const int count = 200000;
+    auto buffer = ringbuffer<int32_t>(4);
+    buffer.setBlockSize(16);
+    auto thread1 = std::thread(
+        [&buffer](){
+            for(int i = 0; i < count; i++) {
+                auto ptr = buffer.getWritePtr();
+                for (int n = 0; n < 16; n++)
+                    ptr[n] = i + n;
+                buffer.WriteDone();
+            }
+        }
+    );
+
+    int errors = 0;
+    for(int i = 0; i < count; i++) {
+        auto ptr = buffer.getReadPtr();
+        for (int n = 0; n < 16; n++)
+            errors += (ptr[n] != i + n);
+        buffer.ReadDone();
+    }
+    thread1.join();
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(buffer.getWriteCount(), count);
+}
+
+TEST_CASE(RingBufferFixture, CountTest)
+{
+    // the blocks are a power of two, one of them stays free
+    auto buffer = ringbuffer<int16_t>(3);
+    buffer.setBlockSize(64);
+    for (int i = 0; i < 3; i++) {
+        CHECK_TRUE(!buffer.isFull());
+        buffer.getWritePtr();
+        buffer.WriteDone();
+    }
+    CHECK_TRUE(buffer.isFull());
+    CHECK_EQUAL(buffer.peekPtr(4), buffer.peekPtr(0));
+    CHECK_EQUAL(buffer.nextIndex(3), 0);
+
+    // a writer waiting for space goes on after Stop()
+    auto thread1 = std::thread(
+        [&buffer](){
+            buffer.getWritePtr();
+        }
+    );
+    std::this_thread::sleep_for(100ms);
+    buffer.Stop();
+    thread1.join();
+    CHECK_TRUE(!buffer.isFull());
+    CHECK_EQUAL(buffer.getReadIndex(), 0);
+}
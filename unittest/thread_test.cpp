@@ -0,0 +1,121 @@
+#include "thread_placement.h"
+
+#include "CppUnitTestFramework.hpp"
+#include <thread>
+#include <chrono>
+#include <string.h>
+
+namespace {
+    struct ThreadFixture {};
+
+    uint64_t Cpus(int first, int last)
+    {
+        uint64_t cpus = 0;
+        for (int n = first; n <= last; n++)
+            cpus |= (uint64_t)1 << n;
+        return cpus;
+    }
+}
+
+TEST_CASE(ThreadFixture, DefaultTest)
+{
+    // no pinning on small hosts, only the USB thread is real time
+    for (int r = 0; r < THREAD_NROLES; r++)
+    {
+        auto placement = threadDefaultPlacement((threadRole)r, 2);
+        CHECK_EQUAL(placement.cpus, (uint64_t)0);
+        CHECK_EQUAL((int)placement.policy, r == THREAD_USB ? (int)THREAD_FIFO : (int)THREAD_OTHER);
+    }
+
+    // the workers on all cpus but the first one
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_USB, 4).cpus, Cpus(0, 0));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_CALLBACK, 4).cpus, Cpus(0, 0));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_STATS, 4).cpus, Cpus(0, 0));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_R2IQ, 4).cpus, Cpus(1, 3));
+
+    // and from 8 on the callback on a cpu of its own
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_USB, 8).cpus, Cpus(0, 0));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_SPECTRUM, 8).cpus, Cpus(0, 0));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_CALLBACK, 8).cpus, Cpus(1, 1));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_R2IQ, 8).cpus, Cpus(2, 7));
+    CHECK_EQUAL(threadDefaultPlacement(THREAD_R2IQ, 128).cpus, Cpus(2, 63));
+}
+
+TEST_CASE(ThreadFixture, ParseTest)
+{
+    const auto usb = threadGetPlacement(THREAD_USB);
+    const auto r2iq = threadGetPlacement(THREAD_R2IQ);
+
+    REQUIRE_TRUE(threadParsePlacement("usb=0:rr:20;r2iq=1-3,5"));
+    auto placement = threadGetPlacement(THREAD_USB);
+    CHECK_EQUAL(placement.cpus, Cpus(0, 0));
+    CHECK_EQUAL((int)placement.policy, (int)THREAD_RR);
+    CHECK_EQUAL(placement.priority, 20);
+    placement = threadGetPlacement(THREAD_R2IQ);
+    CHECK_EQUAL(placement.cpus, Cpus(1, 3) | Cpus(5, 5));
+    CHECK_EQUAL((int)placement.policy, (int)THREAD_OTHER);
+    CHECK_EQUAL(threadCpuCount(THREAD_R2IQ), 4u);
+
+    REQUIRE_TRUE(threadParsePlacement("r2iq=any;"));
+    CHECK_EQUAL(threadGetPlacement(THREAD_R2IQ).cpus, (uint64_t)0);
+    CHECK_EQUAL(threadCpuCount(THREAD_R2IQ), 0u);
+
+    // a wrong entry sets none of them
+    CHECK_TRUE(!threadParsePlacement("usb=1;r2iq=2-1"));
+    CHECK_TRUE(!threadParsePlacement("usb=1;gpu=0"));
+    CHECK_TRUE(!threadParsePlacement("usb=1:fifo:100"));
+    CHECK_TRUE(!threadParsePlacement("usb=64"));
+    CHECK_TRUE(!threadParsePlacement("usb"));
+    CHECK_EQUAL(threadGetPlacement(THREAD_USB).cpus, Cpus(0, 0));
+
+    threadSetPlacement(THREAD_USB, usb);
+    threadSetPlacement(THREAD_R2IQ, r2iq);
+}
+
+TEST_CASE(ThreadFixture, TimesTest)
+{
+    // the time of a running thread and the one it had when it ended
+    const auto stats = threadGetPlacement(THREAD_STATS);
+    threadSetPlacement(THREAD_STATS, { 0, THREAD_OTHER, 0 });
+
+    bool run = true;
+    volatile double sink = 0.0;
+    auto busy = std::thread([&run, &sink]() {
+        threadScope scope(THREAD_STATS, "sddc-test-busy");
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200))
+            sink = sink + 1.0;
+        while (run)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    auto find = [](threadTime& time) {
+        threadTime times[64];
+        const int count = threadGetTimes(times, 64);
+        for (int i = 0; i < count; i++)
+        {
+            if (strcmp(times[i].name, "sddc-test-busy") == 0)
+            {
+                time = times[i];
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    threadTime time;
+    REQUIRE_TRUE(find(time));
+    CHECK_EQUAL(time.running, 1);
+    CHECK_EQUAL((int)time.role, (int)THREAD_STATS);
+    CHECK_TRUE(time.seconds > 0.05 && time.seconds < 1.0);
+
+    run = false;
+    busy.join();
+    const double seconds = time.seconds;
+    REQUIRE_TRUE(find(time));
+    CHECK_EQUAL(time.running, 0);
+    CHECK_TRUE(time.seconds >= seconds && time.seconds < 1.0);
+
+    threadSetPlacement(THREAD_STATS, stats);
+}